@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <string.h>
 #include <time.h>
 
@@ -56,8 +57,22 @@ struct opts {
 	struct blob_params blob_params;
 	struct grid_params grid_params;
 	char *output_file;
+	unsigned int seed;
+	enum opt_value seed_set;
+	unsigned int prototypes;
+	enum opt_value cull;
+	enum opt_value flatten;
+	enum opt_value merge;
+	float simplify;
+	enum opt_value clip;
+	unsigned int threads;
+	unsigned int precision;
+	enum opt_value minify;
+	enum opt_value style_classes;
+	int compress;
 	char *config_file;
 	enum opt_value background;
+	enum opt_value mem_stats;
 	enum opt_value help;
 	enum opt_value verbose;
 	enum opt_value version;
@@ -110,9 +125,34 @@ static void print_usage(const struct opts *opts)
 "  --grid-width     - Output grid width. Default: '%f'.\n"
 "  --grid-wiggle    - Output grid wiggle. Default: '%f'.\n"
 
+"  --prototypes      - Place rotated and scaled copies of this many blob\n"
+"                      shapes instead of unique blobs, 0 for unique blobs.\n"
+"                      Default: '%u'.\n"
+"  --cull            - Drop blobs fully covered by later blobs and report\n"
+"                      the count. Not with --prototypes. Default: '%s'.\n"
+"  --flatten         - Split overlapping blobs into disjoint regions of\n"
+"                      their visible parts, for cutting. Not with\n"
+"                      --prototypes. Default: '%s'.\n"
+"  --merge           - Join overlapping blobs of one color into one path\n"
+"                      each where no other color drawn between them\n"
+"                      overlaps them. With --flatten, join touching\n"
+"                      regions of one color instead. Not with\n"
+"                      --prototypes. Default: '%s'.\n"
+"  --simplify        - Drop blob nodes within this distance of the\n"
+"                      simplified outline, 0 to keep all. Default: '%f'.\n"
+"  --clip            - Clip blobs to the view box and drop the ones outside\n"
+"                      it. Default: '%s'.\n"
+"  --threads         - Worker thread count. Default: '%u'.\n"
+"  --seed            - Random seed. Default: the current time.\n"
+"  --precision       - Output coordinate decimal places. Default: '%u'.\n"
+"  --minify          - Minify output. Default: '%s'.\n"
+"  --style-classes   - Use a style sheet for palette colors. Default: '%s'.\n"
+"  --compress[=L]    - Gzip output at level L, implied by a .svgz\n"
+"                      output file.  Default L: '%d'.\n"
 "  -o --output-file  - Output file. Default: '%s'.\n"
 "  -f --config-file  - Config file. Default: '%s'.\n"
 "  -b --background   - Generate image background. Default: '%s'.\n"
+"  --mem-stats       - Print a memory census at exit. Default: '%s'.\n"
 "  -h --help         - Show this help and exit.\n"
 "  -v --verbose      - Verbose execution.\n"
 "  -V --version      - Display the program version number.\n",
@@ -129,9 +169,21 @@ static void print_usage(const struct opts *opts)
 		opts->grid_params.width,
 		opts->grid_params.wiggle,
 
+		opts->prototypes,
+		(opts->cull == opt_yes ? "yes" : "no"),
+		(opts->flatten == opt_yes ? "yes" : "no"),
+		(opts->merge == opt_yes ? "yes" : "no"),
+		opts->simplify,
+		(opts->clip == opt_yes ? "yes" : "no"),
+		opts->threads,
+		opts->precision,
+		(opts->minify == opt_yes ? "yes" : "no"),
+		(opts->style_classes == opt_yes ? "yes" : "no"),
+		svg_writer_compress_default,
 		opts->output_file,
 		opts->config_file,
-		(opts->background ? "yes" : "no")
+		(opts->background ? "yes" : "no"),
+		(opts->mem_stats == opt_yes ? "yes" : "no")
 	);
 
 	print_bugreport();
@@ -151,9 +203,22 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		{"grid-width",     required_argument, NULL, '8'},
 		{"grid-wiggle",    required_argument, NULL, '9'},
 
+		{"prototypes",     required_argument, NULL, 'k'},
+		{"cull",           no_argument,       NULL, 'c'},
+		{"flatten",        no_argument,       NULL, 'F'},
+		{"merge",          no_argument,       NULL, 'M'},
+		{"simplify",       required_argument, NULL, 'i'},
+		{"clip",           no_argument,       NULL, 'x'},
+		{"threads",        required_argument, NULL, 'T'},
+		{"seed",           required_argument, NULL, 'S'},
+		{"precision",      required_argument, NULL, 'P'},
+		{"minify",         no_argument,       NULL, 'm'},
+		{"style-classes",  no_argument,       NULL, 'C'},
+		{"compress",       optional_argument, NULL, 'z'},
 		{"output-file",    required_argument, NULL, 'o'},
 		{"config-file",    required_argument, NULL, 'f'},
 		{"background",     no_argument,       NULL, 'b'},
+		{"mem-stats",      no_argument,       NULL, 'X'},
 		{"help",           no_argument,       NULL, 'h'},
 		{"verbose",        no_argument,       NULL, 'v'},
 		{"version",        no_argument,       NULL, 'V'},
@@ -165,8 +230,22 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		.blob_params = init_blob_params,
 		.grid_params = init_grid_params,
 		.output_file = "-",
+		.seed = 0,
+		.seed_set = opt_no,
+		.prototypes = 0,
+		.cull = opt_no,
+		.flatten = opt_no,
+		.merge = opt_no,
+		.simplify = 0.0,
+		.clip = opt_no,
+		.threads = 1,
+		.precision = format_precision_default,
+		.minify = opt_no,
+		.style_classes = opt_no,
+		.compress = svg_writer_compress_off,
 		.config_file = NULL,
 		.background = opt_no,
+		.mem_stats = opt_no,
 		.help = opt_no,
 		.verbose = opt_no,
 		.version = opt_no,
@@ -262,6 +341,73 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		case 'b':
 			opts->background = opt_yes;
 			break;
+		case 'k':
+			opts->prototypes = to_unsigned(optarg);
+			if (opts->prototypes == UINT_MAX) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'c':
+			opts->cull = opt_yes;
+			break;
+		case 'F':
+			opts->flatten = opt_yes;
+			break;
+		case 'M':
+			opts->merge = opt_yes;
+			break;
+		case 'i':
+			opts->simplify = to_float(optarg);
+			if (opts->simplify == HUGE_VALF
+				|| opts->simplify < 0.0) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'x':
+			opts->clip = opt_yes;
+			break;
+		case 'T':
+			opts->threads = to_unsigned(optarg);
+			if (opts->threads == UINT_MAX || !opts->threads) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'S':
+			if (to_unsigned_checked(optarg, &opts->seed)) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			opts->seed_set = opt_yes;
+			break;
+		case 'P':
+			opts->precision = to_unsigned(optarg);
+			if (opts->precision == UINT_MAX ||
+				opts->precision > format_precision_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'm':
+			opts->minify = opt_yes;
+			break;
+		case 'C':
+			opts->style_classes = opt_yes;
+			break;
+		case 'z':
+			if (!optarg) {
+				opts->compress = svg_writer_compress_default;
+				break;
+			}
+			opts->compress = (int)to_unsigned(optarg);
+			if (opts->compress < 0 ||
+				opts->compress > svg_writer_compress_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
 		// admin
 		case 'o': {
 			size_t len;
@@ -295,6 +441,9 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 			strcpy(opts->config_file, optarg);
 			break;
 		}
+		case 'X':
+			opts->mem_stats = opt_yes;
+			break;
 		case 'h':
 			opts->help = opt_yes;
 			break;
@@ -325,37 +474,55 @@ struct grid_position {
 	unsigned int number;
 };
 
-static void write_blob(FILE* out_stream, const struct svg_style *style,
-	const struct grid_params *grid_params,
-	const struct blob_params *blob_params,
-	const struct grid_position *pos)
+static void get_blob_offset(const struct grid_params *grid_params,
+	const struct grid_position *pos, struct point_c *blob_offset)
 {
-	char blob_id[256];
-	unsigned int node_count;
-	unsigned int node;
-	struct point_p point_p;
-	struct point_c blob_offset;
-
-	snprintf(blob_id, sizeof(blob_id), "blob_%d", pos->number);
-	node_count = random_int(blob_params->node_count_min,
-		blob_params->node_count_max);
-
-	blob_offset.x = pos->column * grid_params->width
+	blob_offset->x = pos->column * grid_params->width
 		+ random_float(0, grid_params->wiggle);
-	blob_offset.y = pos->row * grid_params->width +
+	blob_offset->y = pos->row * grid_params->width +
 		random_float(0, grid_params->wiggle);
+}
 
-	log("%s: %u nodes at {%u,%u} => {%f,%f}\n",
-		blob_id, node_count, pos->column, pos->row,
-		blob_offset.x, blob_offset.y);
+/* Scratch space for the nodes of one blob. */
+
+struct blob_buffer {
+	struct point_p *polar;
+	struct node_buffer nb;
+	struct clip_buffer cb;
+};
 
-	svg_open_path(out_stream, style, NULL, blob_id);
+static void blob_buffer_init(struct blob_buffer *bb,
+	const struct blob_params *blob_params, struct mem_arena *arena)
+{
+	bb->polar = mem_arena_alloc(arena, blob_params->node_count_max
+		* sizeof(*bb->polar));
+	bb->nb.node_count = 0;
+	bb->nb.nodes = mem_arena_alloc(arena, blob_params->node_count_max
+		* sizeof(*bb->nb.nodes));
+	memset(&bb->cb, 0, sizeof(bb->cb));
+}
+
+// The polar and node arrays go with their arena.
+static void blob_buffer_clean(struct blob_buffer *bb)
+{
+	clip_buffer_clean(&bb->cb);
+}
+
+/*
+ * get_blob_nodes - node_count random nodes around {0,0}, one in each equal
+ * sector of the circle.  The polar nodes are drawn first and converted in
+ * one batch.
+ */
+
+static void get_blob_nodes(const struct blob_params *blob_params,
+	unsigned int node_count, struct blob_buffer *bb)
+{
+	unsigned int node;
+	struct point_p point_p;
 
 	for (node = 0, point_p.t = 0; node < node_count; node++) {
-		struct point_c point_c;
 		float sector_limit = (node + 1) * 360 / node_count;
 		float sector_start;
-		struct point_c final;
 
 		sector_start = point_p.t + blob_params->sector_min;
 		
@@ -369,41 +536,415 @@ static void write_blob(FILE* out_stream, const struct svg_style *style,
 		point_p.r = random_float(blob_params->radius_min,
 			blob_params->radius_max);
 
-		polar_to_cart(&point_p, &point_c);
+		bb->polar[node] = point_p;
+	}
 
-		final.x = point_c.x + blob_offset.x;
-		final.y = point_c.y + blob_offset.y;
+	polar_to_cart_n(bb->polar, bb->nb.nodes, node_count);
+	bb->nb.node_count = node_count;
 
-		if (0) {
+	if (0) {
+		for (node = 0; node < node_count; node++) {
 			fprintf(stderr,
-				"  node_%u: {%f,%f} => {%f,%f} => {%f,%f}\n",
+				"  node_%u: {%f,%f} => {%f,%f}\n",
 				node,
-				point_p.r, point_p.t,
-				point_c.x, point_c.y,
-				final.x, final.y);
+				bb->polar[node].r, bb->polar[node].t,
+				bb->nb.nodes[node].x, bb->nb.nodes[node].y);
 		}
+	}
+}
 
-		if (node == 0) {
-			fprintf(out_stream, "   d=\"M %f,%f\n", final.x,
-				final.y);
-		} else {
-			fprintf(out_stream, "    L %f,%f\n", final.x, final.y);
+/*
+ * A blob_job builds blobs [first, last) of render_order into scene.  Each
+ * blob draws from the counter based random stream of its grid cell, so a
+ * blob doesn't depend on which thread builds it, in what order, or on the
+ * rest of the grid.  Each job keeps its own stats, and allocates from its
+ * own arena.
+ */
+
+struct blob_stats {
+	struct simplify_stats simplify;
+	unsigned int clipped;
+	unsigned int dropped;
+};
+
+struct blob_job {
+	struct svg_scene scene;
+	const struct grid_params *grid_params;
+	const struct blob_params *blob_params;
+	const struct palette *palette;
+	const struct random_perm *render_order;
+	unsigned int prototype_count;
+	unsigned int seed;
+	float simplify;
+	const struct svg_rect *clip;
+	struct blob_stats stats;
+	struct mem_arena *arena;
+	unsigned int first;
+	unsigned int last;
+};
+
+/*
+ * write_blob - With job->clip set the blob is clipped to it, and dropped
+ * if nothing is left.
+ */
+
+static void write_blob(struct svg_scene *scene, unsigned int style,
+	struct blob_job *job, const struct grid_position *pos,
+	struct blob_buffer *bb)
+{
+	const struct blob_params *blob_params = job->blob_params;
+	const struct svg_rect *clip = job->clip;
+	char blob_id[256];
+	unsigned int node_count;
+	struct point_c blob_offset;
+	const struct point_c *nodes;
+
+	snprintf(blob_id, sizeof(blob_id), "blob_%d", pos->number);
+	node_count = random_int(blob_params->node_count_min,
+		blob_params->node_count_max);
+
+	get_blob_offset(job->grid_params, pos, &blob_offset);
+
+	log("%s: %u nodes at {%u,%u} => {%f,%f}\n",
+		blob_id, node_count, pos->column, pos->row,
+		blob_offset.x, blob_offset.y);
+
+	get_blob_nodes(blob_params, node_count, bb);
+	node_buffer_simplify(&bb->nb, job->simplify, &job->stats.simplify);
+
+	nodes = bb->nb.nodes;
+	node_count = bb->nb.node_count;
+
+	// Nodes are relative to the blob, blob_offset is the path origin.
+	if (clip) {
+		node_count = polygon_clip_box(nodes, node_count,
+			clip->x - blob_offset.x, clip->y - blob_offset.y,
+			clip->x + clip->width - blob_offset.x,
+			clip->y + clip->height - blob_offset.y, &bb->cb,
+			&nodes);
+
+		if (!node_count) {
+			log("%s: outside\n", blob_id);
+			job->stats.dropped++;
+			return;
+		}
+		if (nodes != bb->nb.nodes) {
+			job->stats.clipped++;
 		}
 	}
 
-	fprintf(out_stream, "    Z\"\n");
-	svg_close_object(out_stream);
+	svg_scene_add_styled_path(scene, style, NULL, blob_id, &blob_offset,
+		nodes, node_count);
 }
 
-static void write_svg(FILE* out_stream, const struct grid_params *grid_params,
-	const struct blob_params *blob_params, const struct palette *palette,
-	bool background)
+/*
+ * Prototype mode.  The scene gets prototype_count blob shapes in <defs>
+ * with no style of their own, and each grid cell is a <use> of a random
+ * one with a palette fill, a random rotation and a random scale.
+ */
+
+static const float prototype_scale_min = 0.75;
+static const float prototype_scale_max = 1.25;
+
+static void prototype_id(char *buf, size_t len, unsigned int prototype)
 {
+	snprintf(buf, len, "proto_%u", prototype);
+}
+
+// Random stream row of the prototypes, past any grid row.
+static const unsigned int prototype_row = UINT_MAX;
+
+static void write_prototypes(struct svg_scene *scene,
+	const struct blob_params *blob_params, unsigned int prototype_count,
+	unsigned int seed, float simplify, struct simplify_stats *stats,
+	struct mem_arena *arena)
+{
+	char proto_id[256];
+	struct blob_buffer bb;
 	unsigned int i;
+
+	blob_buffer_init(&bb, blob_params, arena);
+
+	svg_scene_open_defs(scene);
+
+	for (i = 0; i < prototype_count; i++) {
+		random_seed_cell(seed, prototype_row, i);
+
+		prototype_id(proto_id, sizeof(proto_id), i);
+		get_blob_nodes(blob_params,
+			random_int(blob_params->node_count_min,
+				blob_params->node_count_max), &bb);
+		node_buffer_simplify(&bb.nb, simplify, stats);
+		svg_scene_add_path(scene, NULL, NULL, proto_id, NULL,
+			bb.nb.nodes, bb.nb.node_count);
+	}
+
+	svg_scene_close_group(scene);
+	blob_buffer_clean(&bb);
+}
+
+/*
+ * write_prototype_use - A <use> can't be clipped, but with job->clip set
+ * one whose bounding box misses it is dropped.
+ */
+
+static void write_prototype_use(struct svg_scene *scene, unsigned int style,
+	struct blob_job *job, const struct grid_position *pos)
+{
+	const struct svg_rect *clip = job->clip;
+	char blob_id[256];
+	char proto_id[256];
+	struct svg_transform transform = null_svg_transform;
+	const struct point_c *at = &transform.translate;
+	float scale;
+	float reach;
+
+	snprintf(blob_id, sizeof(blob_id), "blob_%d", pos->number);
+	prototype_id(proto_id, sizeof(proto_id),
+		random_unsigned(0, job->prototype_count - 1));
+
+	get_blob_offset(job->grid_params, pos, &transform.translate);
+	scale = random_float(prototype_scale_min, prototype_scale_max);
+	transform.scale.x = scale;
+	transform.scale.y = scale;
+	transform.rotation.angle = random_float(0, 360);
+
+	log("%s: %s at {%u,%u} => {%f,%f}\n",
+		blob_id, proto_id, pos->column, pos->row,
+		transform.translate.x, transform.translate.y);
+
+	reach = scale * job->blob_params->radius_max;
+
+	if (clip && (at->x + reach < clip->x
+		|| at->x - reach > clip->x + clip->width
+		|| at->y + reach < clip->y
+		|| at->y - reach > clip->y + clip->height)) {
+		log("%s: outside\n", blob_id);
+		job->stats.dropped++;
+		return;
+	}
+
+	svg_scene_add_styled_use(scene, style, &transform, blob_id, proto_id,
+		0, 0);
+}
+
+static void build_blobs(struct svg_scene *scene, struct blob_job *job)
+{
+	const struct grid_params *grid_params = job->grid_params;
+	const struct palette *palette = job->palette;
+	unsigned int *palette_styles;
 	struct svg_style style;
 	struct grid_position pos;
-	unsigned int *render_order;
+	struct blob_buffer bb;
+	unsigned int cell;
+	unsigned int i;
+
+	// Blobs refer to palette colors by scene style index.
+	palette_styles = mem_arena_alloc(job->arena, palette->color_count
+		* sizeof(*palette_styles));
+
+	for (i = 0; i < palette->color_count; i++) {
+		svg_style_set(&style, palette->colors[i], NULL, 0);
+		palette_styles[i] = svg_scene_add_style(scene, &style);
+	}
+
+	blob_buffer_init(&bb, job->blob_params, job->arena);
+
+	for (i = job->first; i < job->last; i++) {
+		pos.number = i;
+		cell = random_perm_get(job->render_order, i);
+		pos.row = cell / grid_params->columns;
+		pos.column = cell % grid_params->columns;
+
+		random_seed_cell(job->seed, pos.row, pos.column);
+
+		
+		//debug("%u: (%u) = %u, %u\n", i, cell, pos.column, pos.row);
+		if (job->prototype_count) {
+			write_prototype_use(scene,
+				palette_styles[palette_get_random_index(palette)],
+				job, &pos);
+			continue;
+		}
+		write_blob(scene,
+			palette_styles[palette_get_random_index(palette)],
+			job, &pos, &bb);
+	}
+
+	blob_buffer_clean(&bb);
+}
+
+static void *blob_job_run(void *arg)
+{
+	struct blob_job *job = arg;
+
+	build_blobs(&job->scene, job);
+	return NULL;
+}
+
+/*
+ * A write_job serializes scene items [first, last) into a memory writer.
+ */
+
+struct write_job {
+	struct svg_writer writer;
+	const struct svg_scene *scene;
+	unsigned int first;
+	unsigned int last;
+};
+
+enum {write_job_max = 4096U};
+
+static void *write_job_run(void *arg)
+{
+	struct write_job *job = arg;
+
+	svg_scene_write_items(&job->writer, job->scene, job->first, job->last);
+	return NULL;
+}
+
+static void thread_start(pthread_t *thread, void *(*fn)(void *), void *arg)
+{
+	const int result = pthread_create(thread, NULL, fn, arg);
+
+	if (result) {
+		error("pthread_create failed: %s\n", strerror(result));
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void blob_stats_add(struct blob_stats *sum,
+	const struct blob_stats *stats)
+{
+	sum->simplify.node_count += stats->simplify.node_count;
+	sum->simplify.removed += stats->simplify.removed;
+	sum->simplify.max_deviation = max_f(sum->simplify.max_deviation,
+		stats->simplify.max_deviation);
+	sum->clipped += stats->clipped;
+	sum->dropped += stats->dropped;
+}
+
+/*
+ * build_blobs_parallel - Each thread builds one contiguous range of blobs
+ * into its own scene with its own arena, and the scenes are appended to
+ * scene in order.
+ */
+
+static void build_blobs_parallel(struct svg_scene *scene,
+	struct blob_job *init_job, unsigned int thread_count)
+{
+	const unsigned int count = init_job->last;
+	const unsigned int chunk = (count + thread_count - 1) / thread_count;
+	struct mem_arena *arenas;
+	struct blob_job *jobs;
+	pthread_t *threads;
+	unsigned int t;
+
+	arenas = mem_arena_alloc(init_job->arena,
+		thread_count * sizeof(*arenas));
+	jobs = mem_arena_alloc(init_job->arena, thread_count * sizeof(*jobs));
+	threads = mem_arena_alloc(init_job->arena,
+		thread_count * sizeof(*threads));
+
+	for (t = 0; t < thread_count; t++) {
+		jobs[t] = *init_job;
+		memset(&jobs[t].stats, 0, sizeof(jobs[t].stats));
+		mem_arena_init(&arenas[t], 0);
+		jobs[t].arena = &arenas[t];
+		svg_scene_init(&jobs[t].scene);
+		jobs[t].first = (t * chunk < count) ? t * chunk : count;
+		jobs[t].last = (jobs[t].first + chunk < count)
+			? jobs[t].first + chunk : count;
+		thread_start(&threads[t], blob_job_run, &jobs[t]);
+	}
+
+	for (t = 0; t < thread_count; t++) {
+		pthread_join(threads[t], NULL);
+		svg_scene_append(scene, &jobs[t].scene);
+		svg_scene_clean(&jobs[t].scene);
+		mem_arena_clean(&arenas[t]);
+
+		blob_stats_add(&init_job->stats, &jobs[t].stats);
+	}
+}
+
+/*
+ * write_scene_parallel - Items are handed out in rounds of one range per
+ * thread.  Each thread formats its range into a memory writer, and the
+ * ranges are copied to writer in order once the round is joined, so the
+ * output is the same as svg_scene_write().
+ */
+
+static void write_scene_parallel(struct svg_writer *writer,
+	const struct svg_scene *scene, unsigned int thread_count,
+	struct mem_arena *arena)
+{
+	const unsigned int count = scene->item_count;
+	struct write_job *jobs;
+	pthread_t *threads;
+	unsigned int chunk;
+	unsigned int first;
+	unsigned int t;
+
+	chunk = (count + thread_count - 1) / thread_count;
+	if (chunk > write_job_max) {
+		chunk = write_job_max;
+	}
+
+	jobs = mem_arena_alloc(arena, thread_count * sizeof(*jobs));
+	threads = mem_arena_alloc(arena, thread_count * sizeof(*threads));
+
+	for (t = 0; t < thread_count; t++) {
+		jobs[t].scene = scene;
+		svg_writer_init_memory(&jobs[t].writer, 0);
+		svg_writer_set_precision(&jobs[t].writer, writer->precision);
+		svg_writer_set_minify(&jobs[t].writer, writer->minify);
+		svg_writer_set_style_classes(&jobs[t].writer,
+			writer->style_classes);
+	}
+
+	for (first = 0; first < count; first += thread_count * chunk) {
+		for (t = 0; t < thread_count; t++) {
+			jobs[t].first = first + t * chunk;
+			jobs[t].last = jobs[t].first + chunk;
+
+			if (jobs[t].first > count) {
+				jobs[t].first = count;
+			}
+			if (jobs[t].last > count) {
+				jobs[t].last = count;
+			}
+			thread_start(&threads[t], write_job_run, &jobs[t]);
+		}
+
+		for (t = 0; t < thread_count; t++) {
+			pthread_join(threads[t], NULL);
+			svg_writer_write(writer, jobs[t].writer.buf,
+				jobs[t].writer.len);
+			svg_writer_rewind(&jobs[t].writer);
+		}
+	}
+
+	for (t = 0; t < thread_count; t++) {
+		svg_writer_clean(&jobs[t].writer);
+	}
+}
+
+static void write_svg(struct svg_writer *writer,
+	const struct grid_params *grid_params,
+	const struct blob_params *blob_params, const struct palette *palette,
+	bool background, unsigned int prototype_count, bool cull,
+	bool flatten, bool merge, float simplify, bool clip,
+	unsigned int seed, unsigned int thread_count)
+{
+	const unsigned int blob_count = grid_params->columns * grid_params->rows;
+	struct random_perm render_order;
 	struct svg_rect background_rect;
+	struct svg_scene scene;
+	struct mem_arena arena;
+	struct blob_job job = {.simplify = simplify, .arena = &arena};
+	unsigned int shape_count;
 
 	background_rect.width = (2 + grid_params->columns) * grid_params->width;
 	background_rect.height = (2 + grid_params->rows) * grid_params->width;
@@ -411,32 +952,119 @@ static void write_svg(FILE* out_stream, const struct grid_params *grid_params,
 	background_rect.x = -grid_params->width;
 	background_rect.y = -grid_params->width;
 	background_rect.rx = 50.0;
+	background_rect.ry = 0.0;
 
-	svg_open_svg(out_stream, &background_rect);
+	svg_scene_init(&scene);
+	mem_arena_init(&arena, 0);
 
 	if (background) {
-		svg_write_background(out_stream, &svg_style_royal_no_stroke,
+		svg_scene_add_background(&scene, &svg_style_royal_no_stroke,
 			NULL, &background_rect);
 	}
 
-	svg_open_group(out_stream, NULL, NULL, "camo_blobs");
+	if (prototype_count) {
+		write_prototypes(&scene, blob_params, prototype_count, seed,
+			simplify, &job.stats.simplify, &arena);
+	}
+
+	svg_scene_open_group(&scene, NULL, NULL, "camo_blobs");
 
-	render_order = random_array(grid_params->columns * grid_params->rows);
-	svg_stroke_set(&style.stroke,  NULL, 0);
+	random_perm_init(&render_order, blob_count, seed);
 
-	for (i = 0; i < grid_params->columns * grid_params->rows; i++) {
-		pos.number = i;
-		pos.row = render_order[i] / grid_params->columns;
-		pos.column = render_order[i] % grid_params->columns;
-		
-		svg_fill_set(&style.fill, palette_get_random(palette));
+	job.grid_params = grid_params;
+	job.blob_params = blob_params;
+	job.palette = palette;
+	job.render_order = &render_order;
+	job.prototype_count = prototype_count;
+	job.seed = seed;
+	job.clip = clip ? &background_rect : NULL;
+	job.first = 0;
+	job.last = blob_count;
+
+	if (thread_count > 1) {
+		build_blobs_parallel(&scene, &job, thread_count);
+	} else {
+		build_blobs(&scene, &job);
+	}
+
+	svg_scene_close_group(&scene);
+
+	if (simplify > 0.0) {
+		fprintf(stderr,
+			"%s: Simplified away %u of %u nodes, max deviation %f.\n",
+			program_name, job.stats.simplify.removed,
+			job.stats.simplify.node_count,
+			job.stats.simplify.max_deviation);
+	}
+
+	if (clip) {
+		fprintf(stderr,
+			"%s: Clipped %u blobs, dropped %u outside the view.\n",
+			program_name, job.stats.clipped, job.stats.dropped);
+	}
+
+	if (cull) {
+		fprintf(stderr, "%s: Culled %u of %u blobs.\n", program_name,
+			svg_scene_cull(&scene), blob_count);
+	}
+
+	if (flatten) {
+		const unsigned int regions = svg_scene_flatten(&scene, merge,
+			&shape_count);
+
+		fprintf(stderr, "%s: %s %u blobs into %u regions.\n",
+			program_name, merge ? "Merged" : "Flattened",
+			shape_count, regions);
+	} else if (merge) {
+		const unsigned int paths = svg_scene_merge(&scene,
+			&shape_count);
 
-		//debug("%u: (%u) = %u, %u\n", i, render_order[i], pos.column, pos.row);
-		write_blob(out_stream, &style, grid_params, blob_params, &pos);
+		fprintf(stderr, "%s: Merged %u blobs into %u paths.\n",
+			program_name, shape_count, paths);
 	}
 
-	svg_close_group(out_stream);
-	svg_close_svg(out_stream);
+	svg_open_svg(writer, &background_rect);
+
+	if (thread_count > 1) {
+		svg_scene_write_head(writer, &scene);
+		write_scene_parallel(writer, &scene, thread_count, &arena);
+	} else {
+		svg_scene_write(writer, &scene);
+	}
+
+	svg_close_svg(writer);
+	svg_scene_clean(&scene);
+	mem_arena_clean(&arena);
+}
+
+/*
+ * output_size_bound - Upper bound of the write_svg() output size, used to
+ * pre-size a mapped output file.  A prototype use is smaller than a blob.
+ */
+
+static size_t output_size_bound(const struct grid_params *grid_params,
+	const struct blob_params *blob_params, unsigned int prototype_count,
+	unsigned int precision)
+{
+	float extent;
+	unsigned int coord_len;
+	size_t point_len;
+	size_t blob_len;
+
+	extent = (2 + (grid_params->columns > grid_params->rows
+		? grid_params->columns : grid_params->rows)) * grid_params->width
+		+ grid_params->wiggle + blob_params->radius_max;
+
+	// Sign, first digit, decimal point and fraction digits.
+	for (coord_len = 3 + precision; extent >= 10.0f; extent /= 10.0f) {
+		coord_len++;
+	}
+
+	point_len = 2 * coord_len + 8;	// x,y plus "\n    L ".
+	blob_len = 512 + (size_t)blob_params->node_count_max * point_len;
+
+	return 4096 + ((size_t)grid_params->columns * grid_params->rows
+		+ prototype_count) * blob_len;
 }
 
 struct config_cb_data {
@@ -444,8 +1072,7 @@ struct config_cb_data {
 	struct blob_params *blob_params;
 	struct grid_params *grid_params;
 	struct palette* palette;
-	struct color_data *color_data;
-	unsigned color_counter;
+	VECTOR(struct color_data) color_data;
 };
 
 static void config_cb(void *cb_data, const char *section, char *config_data)
@@ -526,6 +1153,7 @@ static void config_cb(void *cb_data, const char *section, char *config_data)
 	if (!strcmp(section, "[palette]")) {
 		char *weight = strtok(config_data, ",");
 		char *value = strtok(NULL, " \t");
+		struct color_data *color;
 
 		if (!weight) {
 			error("Bad config weight, section %s: '%s'\n", section,
@@ -553,22 +1181,18 @@ static void config_cb(void *cb_data, const char *section, char *config_data)
 			exit(EXIT_FAILURE);
 		}
 		
-		cbd->color_data = mem_realloc(cbd->color_data,
-			sizeof(*cbd->color_data) * (cbd->color_counter + 1));
-		cbd->color_data[cbd->color_counter].weight = to_unsigned(weight);
-		memcpy(&cbd->color_data[cbd->color_counter].value, value,
-			hex_color_len);
-		cbd->color_counter++;
+		color = vector_add(&cbd->color_data);
+		color->weight = to_unsigned(weight);
+		memcpy(&color->value, value, hex_color_len);
 
 		return;
 	}
 
 	if (!strcmp(section, "ON_EXIT")) {
-		if (cbd->color_data) {
-			palette_fill(cbd->palette, cbd->color_data,
-				cbd->color_counter);
-			mem_free(cbd->color_data);
-			cbd->color_data = NULL;
+		if (cbd->color_data.count) {
+			palette_fill(cbd->palette, cbd->color_data.items,
+				cbd->color_data.count);
+			vector_clean(&cbd->color_data);
 		} else {
 			warn("No palette found in config file: '%s'\n",
 				cbd->config_file);
@@ -625,6 +1249,7 @@ int main(int argc, char *argv[])
 {
 	struct opts opts;
 	FILE *out_stream;
+	struct svg_writer writer;
 	struct palette palette = {0};
 
 	log_set_exit_on_error(true);
@@ -685,10 +1310,30 @@ int main(int argc, char *argv[])
 		opts.grid_params.wiggle = 0.8 * opts.blob_params.radius_max;
 	}
 
+	// Placed prototypes are transformed <use>s the scene passes can't see.
+	if (opts.prototypes && opts.cull == opt_yes) {
+		error("--cull does not work with --prototypes.\n");
+		return EXIT_FAILURE;
+	}
+	if (opts.prototypes && opts.flatten == opt_yes) {
+		error("--flatten does not work with --prototypes.\n");
+		return EXIT_FAILURE;
+	}
+	if (opts.prototypes && opts.merge == opt_yes) {
+		error("--merge does not work with --prototypes.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (opts.compress == svg_writer_compress_off &&
+		svg_writer_is_svgz(opts.output_file)) {
+		opts.compress = svg_writer_compress_default;
+	}
+
 	if (!strcmp(opts.output_file, "-")) {
 		out_stream = stdout;
 	} else {
-		out_stream = fopen(opts.output_file, "w");
+		// Read access is needed to map the file.
+		out_stream = fopen(opts.output_file, "w+");
 		if (!out_stream) {
 			error("open <output-file> '%s' failed: %s\n",
 				opts.output_file, strerror(errno));
@@ -702,17 +1347,44 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
+	if (opts.mem_stats == opt_yes) {
+		mem_census_start();
+	}
+
+	if (opts.seed_set != opt_yes) {
+		opts.seed = (unsigned int)time(NULL);
+	}
+	log("seed = %u\n", opts.seed);
+
 	if (opts.config_file){
 		mem_free(opts.config_file);
 		opts.config_file = NULL;
 	}
 
-	srand((unsigned int)time(NULL));
 
-	write_svg(out_stream, &opts.grid_params, &opts.blob_params, &palette,
-		opts.background);
+	if (out_stream != stdout &&
+		opts.compress == svg_writer_compress_off) {
+		svg_writer_init_map(&writer, out_stream,
+			output_size_bound(&opts.grid_params,
+				&opts.blob_params, opts.prototypes,
+				opts.precision));
+	} else {
+		svg_writer_init(&writer, out_stream, 0);
+	}
+	svg_writer_set_precision(&writer, opts.precision);
+	svg_writer_set_minify(&writer, opts.minify == opt_yes);
+	svg_writer_set_style_classes(&writer, opts.style_classes == opt_yes);
+
+	if (opts.compress != svg_writer_compress_off) {
+		svg_writer_compress(&writer, opts.compress);
+	}
+	write_svg(&writer, &opts.grid_params, &opts.blob_params, &palette,
+		opts.background, opts.prototypes, opts.cull == opt_yes,
+		opts.flatten == opt_yes, opts.merge == opt_yes, opts.simplify,
+		opts.clip == opt_yes, opts.seed, opts.threads);
+	svg_writer_clean(&writer);
 
-	mem_free(palette.colors);
+	palette_clean(&palette);
 
 	return EXIT_SUCCESS;
 }
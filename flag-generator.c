@@ -40,6 +40,12 @@ enum opt_value {opt_undef = 0, opt_yes, opt_no};
 struct opts {
 	float height;
 	char *output_file;
+	unsigned int seed;
+	enum opt_value seed_set;
+	unsigned int precision;
+	enum opt_value minify;
+	int compress;
+	enum opt_value mem_stats;
 	enum opt_value help;
 	enum opt_value verbose;
 	enum opt_value version;
@@ -54,13 +60,23 @@ static void print_usage(const struct opts *opts)
 "Usage: %s [flags]\n"
 "Option flags:\n"
 "  --height          - Height of flag. Default: '%f'.\n"
+"  --seed            - Random seed. Default: the current time.\n"
+"  --precision       - Output coordinate decimal places. Default: '%u'.\n"
+"  --minify          - Minify output. Default: '%s'.\n"
+"  --compress[=L]    - Gzip output at level L, implied by a .svgz\n"
+"                      output file.  Default L: '%d'.\n"
 "  -o --output-file  - Output file. Default: '%s'.\n"
+"  --mem-stats       - Print a memory census at exit. Default: '%s'.\n"
 "  -h --help         - Show this help and exit.\n"
 "  -v --verbose      - Verbose execution.\n"
 "  -V --version      - Display the program version number.\n",
 		program_name, program_name,
 		opts->height,
-		opts->output_file
+		opts->precision,
+		(opts->minify == opt_yes ? "yes" : "no"),
+		svg_writer_compress_default,
+		opts->output_file,
+		(opts->mem_stats == opt_yes ? "yes" : "no")
 	);
 
 	print_bugreport();
@@ -70,7 +86,12 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 {
 	static const struct option long_options[] = {
 		{"height",      required_argument, NULL, '1'},
+		{"seed",        required_argument, NULL, 'S'},
+		{"precision",   required_argument, NULL, 'P'},
+		{"minify",      no_argument,       NULL, 'm'},
+		{"compress",    optional_argument, NULL, 'z'},
 		{"output-file", required_argument, NULL, 'o'},
+		{"mem-stats",   no_argument,       NULL, 'X'},
 		{"help",        no_argument,       NULL, 'h'},
 		{"verbose",     no_argument,       NULL, 'v'},
 		{"version",     no_argument,       NULL, 'V'},
@@ -81,6 +102,12 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 	*opts = (struct opts){
 		.height = 10000.0,
 		.output_file = "-",
+		.seed = 0,
+		.seed_set = opt_no,
+		.precision = format_precision_default,
+		.minify = opt_no,
+		.compress = svg_writer_compress_off,
+		.mem_stats = opt_no,
 		.help = opt_no,
 		.verbose = opt_no,
 		.version = opt_no,
@@ -116,6 +143,36 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 				return -1;
 			}
 			break;
+		case 'S':
+			if (to_unsigned_checked(optarg, &opts->seed)) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			opts->seed_set = opt_yes;
+			break;
+		case 'P':
+			opts->precision = to_unsigned(optarg);
+			if (opts->precision == UINT_MAX ||
+				opts->precision > format_precision_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'm':
+			opts->minify = opt_yes;
+			break;
+		case 'z':
+			if (!optarg) {
+				opts->compress = svg_writer_compress_default;
+				break;
+			}
+			opts->compress = (int)to_unsigned(optarg);
+			if (opts->compress < 0 ||
+				opts->compress > svg_writer_compress_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
 		// admin
 		case 'o': {
 			size_t len;
@@ -133,6 +190,9 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 			strcpy(opts->output_file, optarg);
 			break;
 		}
+		case 'X':
+			opts->mem_stats = opt_yes;
+			break;
 		case 'h':
 			opts->help = opt_yes;
 			break;
@@ -193,11 +253,19 @@ static void flag_dimensions_fill(struct flag_dimensions *fd, float height)
 	fd->star_diameter = fd->stripe_height * 4.0 / 5.0;
 }
 
-static void write_stars(FILE* out_stream, struct flag_dimensions *fd)
+/*
+ * write_stars - The 50 stars on a 9 row by 11 column grid, every other
+ * cell.  svg_scene_write() puts the star in <defs> once and writes each
+ * one as a <use> of it.
+ */
+
+static void write_stars(struct svg_writer *writer, struct flag_dimensions *fd)
 {
 	struct star_params star_params;
 	struct svg_style style;
-	struct svg_transform tform;
+	struct svg_scene scene;
+	unsigned int number = 0;
+	unsigned int row;
 
 	star_params.points = 5;
 	star_params.density = 2;
@@ -207,48 +275,32 @@ static void write_stars(FILE* out_stream, struct flag_dimensions *fd)
 	svg_style_set(&style, flag_colors_full.white, NULL, 0);
 	//svg_style_set(&style, _hex_color_yellow, NULL, 0);
 
-	tform = null_svg_transform;
-	tform.translate.x = fd->star_h_grid;
-	tform.translate.y = fd->star_v_grid;
-
-	svg_open_group(out_stream, &style, NULL, "star_group");
-	svg_open_group(out_stream, NULL, NULL, "stars_18");
-	svg_open_group(out_stream, NULL, NULL, "stars_9");
-	svg_open_group(out_stream, NULL, NULL, "stars_5");
-	svg_open_group(out_stream, NULL, NULL, "stars_4");
-	svg_write_star(out_stream, NULL, &tform, "stars_1", &star_params);
-
-	fprintf(out_stream, "<use xlink:href=\"#stars_1\" y=\"%f\"/>\n",
-		2.0 * fd->star_v_grid);
-	fprintf(out_stream, "<use xlink:href=\"#stars_1\" y=\"%f\"/>\n",
-		4.0 * fd->star_v_grid);
-	fprintf(out_stream, "<use xlink:href=\"#stars_1\" y=\"%f\"/>\n",
-		6.0 * fd->star_v_grid);
-	svg_close_group(out_stream); // stars_4
-
-	fprintf(out_stream, "<use xlink:href=\"#stars_1\" y=\"%f\"/>\n",
-		8.0 * fd->star_v_grid);
-	svg_close_group(out_stream); // stars_5
-
-	fprintf(out_stream, "<use xlink:href=\"#stars_4\" x=\"%f\" y=\"%f\"/>\n",
-		1.0 * fd->star_h_grid, 1.0 * fd->star_v_grid);
-	svg_close_group(out_stream); // stars_9
-
-	fprintf(out_stream, "<use xlink:href=\"#stars_9\" x=\"%f\"/>\n",
-		2.0 * fd->star_h_grid);
-	svg_close_group(out_stream); // stars_18
-
-	fprintf(out_stream, "<use xlink:href=\"#stars_18\" x=\"%f\"/>\n",
-		4.0 * fd->star_h_grid);
-	fprintf(out_stream, "<use xlink:href=\"#stars_9\" x=\"%f\"/>\n",
-		8.0 * fd->star_h_grid);
-	fprintf(out_stream, "<use xlink:href=\"#stars_5\" x=\"%f\"/>\n",
-		10.0 * fd->star_h_grid);
-
-	svg_close_group(out_stream); // star_group
+	svg_scene_init(&scene);
+
+	svg_scene_open_group(&scene, NULL, NULL, "star_group");
+
+	for (row = 1; row <= 9; row++) {
+		unsigned int column;
+
+		for (column = 2 - row % 2; column <= 11; column += 2) {
+			char id[16];
+
+			snprintf(id, sizeof(id), "star_%u", ++number);
+			star_params.position.x = column * fd->star_h_grid;
+			star_params.position.y = row * fd->star_v_grid;
+			svg_scene_add_star(&scene, &style, NULL, id,
+				&star_params);
+		}
+	}
+	assert(number == 50);
+
+	svg_scene_close_group(&scene); // star_group
+
+	svg_scene_write(writer, &scene);
+	svg_scene_clean(&scene);
 }
 
-static void write_flag(FILE* out_stream, float height)
+static void write_flag(struct svg_writer *writer, float height)
 {
 	struct flag_dimensions fd;
 	static const char flag_id[] = "flag_usa_1";
@@ -279,28 +331,32 @@ static void write_flag(FILE* out_stream, float height)
 	sr.y = 0.0;
 	sr.rx = 0.0;
 	sr.ry = 0.0;
-	svg_write_rect(out_stream, &style, NULL, "white_background", &sr);
+	svg_write_rect(writer, &style, NULL, "white_background", &sr);
 
 	// red_stripes
 	svg_style_set(&style, NULL, flag_colors_full.red, fd.stripe_height);
 
-	svg_open_path(out_stream, &style, NULL, "red_stripes");
-	fprintf(out_stream, "d=\"\n");
+	svg_open_path(writer, &style, NULL, "red_stripes");
+	svg_open_attr(writer, "d");
+	svg_writer_eol(writer);
 	for (i = 0; i < 7; i++) {
-		fprintf(out_stream, "M0,%f H%f\n",
-			(0.5 + 2.0 * i) * fd.stripe_height, fd.width);
+		svg_writer_puts(writer, "M0,");
+		svg_writer_put_float(writer, (0.5 + 2.0 * i) * fd.stripe_height);
+		svg_writer_puts(writer, writer->minify ? "H" : " H");
+		svg_writer_put_float(writer, fd.width);
+		svg_writer_eol(writer);
 	}
-	fprintf(out_stream, "\"\n");
-	svg_close_object(out_stream);
+	svg_close_attr(writer);
+	svg_close_object(writer);
 
 	// blue_background
 	svg_style_set(&style, flag_colors_full.blue, NULL, 0);
 
 	sr.width = fd.blue_width;
 	sr.height = fd.blue_height;
-	svg_write_rect(out_stream, &style, NULL, "blue_background", &sr);
+	svg_write_rect(writer, &style, NULL, "blue_background", &sr);
 
-	if (svg_debug_stream()) {
+	if (svg_debug_writer()) {
 		// v_grid
 		style = svg_style_light_green_light_green;
 		style.stroke.width = 1.0 + fd.height / 1000.0;
@@ -309,7 +365,7 @@ static void write_flag(FILE* out_stream, float height)
 		sl.b.x = fd.blue_width;
 		sl.a.y = sl.b.y = 0.0;
 		for (i = 0; i < 11; i++) {
-			svg_write_line(svg_debug_stream(), &style, NULL, "v_grid", &sl);
+			svg_write_line(svg_debug_writer(), &style, NULL, "v_grid", &sl);
 			sl.a.y = sl.b.y += fd.star_v_grid;
 		}
 
@@ -321,27 +377,28 @@ static void write_flag(FILE* out_stream, float height)
 		sl.b.y = fd.blue_height;
 		sl.a.x = sl.b.x = 0.0;
 		for (i = 0; i < 13; i++) {
-			svg_write_line(svg_debug_stream(), &style, NULL, "h_grid", &sl);
+			svg_write_line(svg_debug_writer(), &style, NULL, "h_grid", &sl);
 			sl.a.x = sl.b.x += fd.star_h_grid;
 		}
 	}
 	
-	write_stars(out_stream, &fd);
+	write_stars(writer, &fd);
 
 }
 
-static void write_svg(FILE* out_stream, float height)
+static void write_svg(struct svg_writer *writer, float height)
 {
-	svg_open_svg(out_stream, NULL);
-	//svg_debug_stream_set(out_stream);
-	write_flag(out_stream, height);
-	svg_close_svg(out_stream);
+	svg_open_svg(writer, NULL);
+	//svg_debug_writer_set(writer);
+	write_flag(writer, height);
+	svg_close_svg(writer);
 }
 
 int main(int argc, char *argv[])
 {
 	struct opts opts;
 	FILE *out_stream;
+	struct svg_writer writer;
 
 	log_set_exit_on_error(true);
 
@@ -376,7 +433,29 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
-	write_svg(out_stream, opts.height);
+	if (opts.mem_stats == opt_yes) {
+		mem_census_start();
+	}
+
+	if (opts.seed_set != opt_yes) {
+		opts.seed = (unsigned int)time(NULL);
+	}
+	log("seed = %u\n", opts.seed);
+	random_seed(opts.seed);
+
+	svg_writer_init(&writer, out_stream, 0);
+	svg_writer_set_precision(&writer, opts.precision);
+	svg_writer_set_minify(&writer, opts.minify == opt_yes);
+
+	if (opts.compress == svg_writer_compress_off &&
+		svg_writer_is_svgz(opts.output_file)) {
+		opts.compress = svg_writer_compress_default;
+	}
+	if (opts.compress != svg_writer_compress_off) {
+		svg_writer_compress(&writer, opts.compress);
+	}
+	write_svg(&writer, opts.height);
+	svg_writer_clean(&writer);
 
 	return EXIT_SUCCESS;
 }
@@ -11,6 +11,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +19,7 @@
 #include "color.h"
 #include "log.h"
 #include "mem.h"
+#include "random.h"
 #include "util.h"
 
 bool is_hex_color(const char *str)
@@ -71,34 +73,148 @@ void hex_color_clear(char *color)
 #endif
 }
 
+void palette_clean(struct palette *palette)
+{
+	if (palette->colors) {
+		mem_free(palette->colors);
+		mem_free(palette->limit);
+		mem_free(palette->alias);
+	}
+	memset(palette, 0, sizeof(*palette));
+}
+
+/*
+ * palette_build_alias - Vose's alias method.  Scaled by color_count, each
+ * weight is compared to the bucket size weight_total.  Each bucket of a
+ * color under the bucket size is topped up from a color over it.
+ */
+
+static void palette_build_alias(struct palette *palette,
+	const unsigned long long *scaled, struct mem_arena *scratch)
+{
+	const unsigned long long bucket = palette->weight_total;
+	const unsigned int count = palette->color_count;
+	unsigned long long *left;
+	unsigned int *work;
+	unsigned int small;
+	unsigned int large;
+	unsigned int i;
+
+	left = mem_arena_alloc(scratch, count * sizeof(*left));
+	work = mem_arena_alloc(scratch, count * sizeof(*work));
+
+	// Under-full colors fill work from the front, the rest from the back.
+	for (i = 0, small = 0, large = count; i < count; i++) {
+		left[i] = scaled[i];
+		if (left[i] < bucket) {
+			work[small++] = i;
+		} else {
+			work[--large] = i;
+		}
+	}
+
+	while (small && large < count) {
+		const unsigned int s = work[--small];
+		const unsigned int l = work[large];
+
+		palette->limit[s] = (unsigned int)left[s];
+		palette->alias[s] = l;
+
+		left[l] -= bucket - left[s];
+		if (left[l] < bucket) {
+			large++;
+			work[small++] = l;
+		}
+	}
+
+	// What is left is full, up to rounding.
+	while (small) {
+		const unsigned int s = work[--small];
+
+		palette->limit[s] = palette->weight_total;
+		palette->alias[s] = s;
+	}
+	for (; large < count; large++) {
+		const unsigned int l = work[large];
+
+		palette->limit[l] = palette->weight_total;
+		palette->alias[l] = l;
+	}
+}
+
+/*
+ * palette_fill - Set palette to the colors of data with a nonzero weight.
+ * Memory is linear in the number of colors, whatever the weights, and the
+ * working arrays share one scratch arena.
+ */
+
 void palette_fill(struct palette *palette, const struct color_data *data,
 	unsigned int data_len)
 {
+	struct mem_arena scratch;
+	unsigned long long *scaled;
+	unsigned long long total;
 	unsigned int i;
 	unsigned int out;
 
-	if (palette->colors) {
-		mem_free(palette->colors);
-		palette->colors = NULL;
+	palette_clean(palette);
+
+	for (i = 0, total = 0; i < data_len; i++) {
+		if (data[i].weight) {
+			palette->color_count++;
+			total += data[i].weight;
+		}
 	}
 
-	for (i = 0, palette->color_count = 0; i < data_len; i++) {
-		palette->color_count += data[i].weight;
+	if (!palette->color_count) {
+		return;
 	}
 
-	palette->colors =  mem_alloc(palette->color_count * hex_color_len);
+	if (total > UINT_MAX) {
+		error("Palette weight total too big: %llu\n", total);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+	palette->weight_total = (unsigned int)total;
+
+	palette->colors = mem_alloc(palette->color_count * hex_color_len);
+	palette->limit = mem_alloc(palette->color_count
+		* sizeof(*palette->limit));
+	palette->alias = mem_alloc(palette->color_count
+		* sizeof(*palette->alias));
+	mem_arena_init(&scratch, 0);
+	scaled = mem_arena_alloc(&scratch,
+		palette->color_count * sizeof(*scaled));
 
 	for (i = 0, out = 0; i < data_len; i++) {
-		unsigned int j;
-		for (j = 0; j < data[i].weight; j++, out++) {
-			debug("Add %s\n", data[i].value);
-			memcpy(&palette->colors[out], data[i].value,
-				hex_color_len);
+		if (!data[i].weight) {
+			continue;
 		}
+		debug("Add %s, %u\n", data[i].value, data[i].weight);
+		memcpy(&palette->colors[out], data[i].value, hex_color_len);
+		scaled[out] = (unsigned long long)data[i].weight
+			* palette->color_count;
+		out++;
 	}
+
+	palette_build_alias(palette, scaled, &scratch);
+	mem_arena_clean(&scratch);
+}
+
+unsigned int palette_get_random_index(const struct palette *palette)
+{
+	unsigned int i;
+	unsigned int r;
+
+	assert(palette->color_count);
+
+	i = random_unsigned(0, palette->color_count - 1);
+	r = random_unsigned(0, palette->weight_total - 1);
+
+	return (r < palette->limit[i]) ? i : palette->alias[i];
 }
 
 const char *palette_get_random(const struct palette *palette)
 {
-	return palette->colors[random_unsigned(0, palette->color_count - 1)];
+	return palette->colors[palette_get_random_index(palette)];
 }
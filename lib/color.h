@@ -46,10 +46,20 @@ struct color_data
 	char value[hex_color_len];
 };
 
+/*
+ * A palette holds each color once, with a Vose alias table for weighted
+ * sampling.  Bucket i is picked uniformly, then a uniform r in
+ * [0, weight_total) selects color i when r < limit[i] and alias[i]
+ * otherwise.  All integer, so the draw is exact for any weights.
+ */
+
 struct palette
 {
 	unsigned int color_count;
 	char (*colors)[hex_color_len];
+	unsigned int *limit;
+	unsigned int *alias;
+	unsigned int weight_total;
 };
 
 bool is_hex_color(const char *p);
@@ -59,6 +69,8 @@ void hex_color_clear(char *color);
 void palette_parse_config(const char *config_file, struct palette *palette);
 void palette_fill(struct palette *palette, const struct color_data *data,
 	unsigned int data_len);
+void palette_clean(struct palette *palette);
+unsigned int palette_get_random_index(const struct palette *palette);
 const char *palette_get_random(const struct palette *palette);
 
 #endif /* _MD_GENERATOR_COLOR_H */
@@ -10,6 +10,7 @@
 #endif
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +21,23 @@
 #include "log.h"
 #include "util.h"
 
+/* config_hex_color - A hex color at p, up to white space or the end. */
+
+static bool config_hex_color(const char *p)
+{
+	char color[hex_color_len];
+
+	if (strnlen(p, hex_color_len - 1) < hex_color_len - 1) {
+		return false;
+	}
+
+	memcpy(color, p, hex_color_len - 1);
+	color[hex_color_len - 1] = 0;
+
+	return is_hex_color(color)
+		&& (!p[hex_color_len - 1] || isspace(p[hex_color_len - 1]));
+}
+
 char *config_clean_data(char *p)
 {
 	char *start;
@@ -29,8 +47,8 @@ char *config_clean_data(char *p)
 	p = start = (char *)eat_front_ws(p);
 
 	while (*p) {
-		if (is_hex_color(p)) {
-			p += 7;
+		if (config_hex_color(p)) {
+			p += hex_color_len - 1;
 			continue;
 		}
 		if (*p == '\n'  || *p == '\r' || *p == '#') {
@@ -0,0 +1,188 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "format.h"
+
+static const double pow10_f[format_precision_max + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+static const unsigned long long pow10_u[format_precision_max + 1] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL,
+};
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* Values whose scaled magnitude is past this go through snprintf. */
+static const double fixed_limit = 4.0e18;
+
+/*
+ * format_to_fixed - Scale value to an integer count of 10^-precision units.
+ * A float times 10^9 or less is exact in a double, so llrint() rounds the
+ * same way printf("%.*f") does.  Returns LLONG_MIN when out of range.
+ */
+
+long long format_to_fixed(float value, unsigned int precision)
+{
+	double scaled;
+
+	assert(precision <= format_precision_max);
+
+	scaled = (double)value * pow10_f[precision];
+
+	if (!(scaled > -fixed_limit && scaled < fixed_limit)) {
+		return LLONG_MIN;
+	}
+
+	return llrint(scaled);
+}
+
+static void write_digits(char *buf, unsigned long long u,
+	unsigned int count)
+{
+	char *p = buf + count;
+
+	while (count >= 2) {
+		const unsigned int i = (u % 100) * 2;
+
+		u /= 100;
+		*--p = digit_pairs[i + 1];
+		*--p = digit_pairs[i];
+		count -= 2;
+	}
+	if (count) {
+		*--p = (char)('0' + u % 10);
+	}
+}
+
+static unsigned int digit_count(unsigned long long u)
+{
+	unsigned int count = 1;
+
+	while (u >= 10) {
+		u /= 10;
+		count++;
+	}
+	return count;
+}
+
+unsigned int format_fixed(char *buf, long long fixed, unsigned int precision)
+{
+	unsigned long long u;
+	unsigned long long int_part;
+	unsigned long long frac_part;
+	unsigned int count;
+	char *p = buf;
+
+	assert(precision <= format_precision_max);
+
+	if (fixed < 0) {
+		*p++ = '-';
+		u = 0ULL - (unsigned long long)fixed;
+	} else {
+		u = (unsigned long long)fixed;
+	}
+
+	int_part = u / pow10_u[precision];
+	frac_part = u % pow10_u[precision];
+
+	if (!int_part && !frac_part) {
+		buf[0] = '0';
+		return 1;
+	}
+
+	count = digit_count(int_part);
+	write_digits(p, int_part, count);
+	p += count;
+
+	if (frac_part) {
+		count = precision;
+		while (frac_part % 10 == 0) {
+			frac_part /= 10;
+			count--;
+		}
+		*p++ = '.';
+		write_digits(p, frac_part, count);
+		p += count;
+	}
+
+	return (unsigned int)(p - buf);
+}
+
+static unsigned int format_float_slow(char *buf, float value,
+	unsigned int precision)
+{
+	int len = snprintf(buf, format_float_len, "%.*f", precision, value);
+
+	assert(len > 0 && len < (int)format_float_len);
+
+	if (memchr(buf, '.', len)) {
+		while (buf[len - 1] == '0') {
+			len--;
+		}
+		if (buf[len - 1] == '.') {
+			len--;
+		}
+	}
+	return (unsigned int)len;
+}
+
+unsigned int format_float(char *buf, float value, unsigned int precision)
+{
+	const long long fixed = format_to_fixed(value, precision);
+
+	if (fixed == LLONG_MIN) {
+		return format_float_slow(buf, value, precision);
+	}
+	return format_fixed(buf, fixed, precision);
+}
+
+/*
+ * format_points - Write count points as "x,y" pairs joined by sep.  buf must
+ * hold count * format_point_len(strlen(sep)) bytes.
+ */
+
+unsigned int format_points(char *buf, const struct point_c *points,
+	unsigned int count, unsigned int precision, const char *sep)
+{
+	const size_t sep_len = strlen(sep);
+	unsigned int i;
+	char *p = buf;
+
+	for (i = 0; i < count; i++) {
+		if (i) {
+			memcpy(p, sep, sep_len);
+			p += sep_len;
+		}
+		p += format_float(p, points[i].x, precision);
+		*p++ = ',';
+		p += format_float(p, points[i].y, precision);
+	}
+
+	return (unsigned int)(p - buf);
+}
@@ -0,0 +1,34 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#if ! defined(_MD_GENERATOR_FORMAT_H)
+#define _MD_GENERATOR_FORMAT_H
+
+#include "geometry.h"
+
+/*
+ * Fixed precision float to ASCII.  Output has at most precision decimals
+ * with trailing zeros (and a bare decimal point) removed, so 1.500000 is
+ * written as "1.5" and 2.000000 as "2".
+ */
+
+enum {
+	format_precision_default = 6U,
+	format_precision_max = 9U,
+	format_float_len = 64U,	// worst case for a single value.
+};
+
+long long format_to_fixed(float value, unsigned int precision);
+unsigned int format_fixed(char *buf, long long fixed, unsigned int precision);
+unsigned int format_float(char *buf, float value, unsigned int precision);
+
+static inline unsigned int format_point_len(unsigned int sep_len)
+{
+	return 2U * format_float_len + 1U + sep_len;
+}
+
+unsigned int format_points(char *buf, const struct point_c *points,
+	unsigned int count, unsigned int precision, const char *sep);
+
+#endif /* _MD_GENERATOR_FORMAT_H */
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fenv.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -19,27 +20,130 @@
 #include "log.h"
 #include "mem.h"
 #include "svg.h"
+#include "util.h"
+#include "vector.h"
 
-struct point_c *polar_to_cart(const struct point_p *p, struct point_c *c)
+/*
+ * Batched polar to cartesian conversion.  polar_batch points at a time go
+ * through a sincos on GCC vector types, which build to SSE2 or, with AVX2
+ * enabled, AVX2 instructions.
+ *
+ * The angle is in degrees, so it is reduced exactly to a quadrant q and a
+ * remainder in [-45, 45] degrees, and sin and cos of the remainder are
+ * minimax polynomials good to about 1 ulp.  The quadrant is rounded with
+ * the 1.5 * 2^23 trick, which needs |t| / 90 < 2^22.  Larger and non-finite
+ * angles are flagged as out of range.
+ */
+
+#if defined(__AVX2__)
+enum {polar_batch = 8};
+#else
+enum {polar_batch = 4};
+#endif
+
+typedef float polar_vec
+	__attribute__ ((vector_size (polar_batch * sizeof(float))));
+typedef unsigned int polar_ivec
+	__attribute__ ((vector_size (polar_batch * sizeof(unsigned int))));
+
+static const float polar_round = 12582912.0f;	// 1.5 * 2^23.
+static const float polar_t_max = 3.7e8f;	// < 90 * 2^22.
+
+static polar_vec polar_select(polar_ivec mask, polar_vec a, polar_vec b)
+{
+	return (polar_vec)(((polar_ivec)a & mask) | ((polar_ivec)b & ~mask));
+}
+
+/*
+ * polar_vec_to_cart - x = r cos(t), y = r sin(t) for t in degrees.  Returns
+ * a mask of the lanes with t out of range.
+ */
+
+static polar_ivec polar_vec_to_cart(polar_vec r, polar_vec t, polar_vec *x,
+	polar_vec *y)
+{
+	const polar_vec q_round = t * (1.0f / 90.0f) + polar_round;
+	const polar_ivec q = (polar_ivec)q_round;
+	const polar_vec k = q_round - polar_round;
+	const polar_vec a = (t - k * 90.0f) * (float)(M_PI / 180.0);
+	const polar_vec a2 = a * a;
+	const polar_ivec swap = -(q & 1);
+	const polar_ivec sin_sign = (q & 2) << 30;
+	const polar_ivec cos_sign = ((q ^ (q >> 1)) & 1) << 31;
+	polar_vec s;
+	polar_vec c;
+	polar_vec abs_t;
+
+	s = a + a * a2 * (-1.6666654611e-1f + a2 * (8.3321608736e-3f
+		+ a2 * -1.9515295891e-4f));
+	c = 1.0f - 0.5f * a2 + a2 * a2 * (4.166664568298827e-2f
+		+ a2 * (-1.388731625493765e-3f + a2 * 2.443315711809948e-5f));
+
+	*y = r * (polar_vec)((polar_ivec)polar_select(swap, c, s) ^ sin_sign);
+	*x = r * (polar_vec)((polar_ivec)polar_select(swap, s, c) ^ cos_sign);
+
+	abs_t = (polar_vec)((polar_ivec)t & 0x7fffffff);
+	return ~(polar_ivec)(abs_t < polar_t_max);
+}
+
+/*
+ * polar_to_cart_n - polar_to_cart() of count points.  The range and floating
+ * point exception checks are made once for the whole call.
+ */
+
+void polar_to_cart_n(const struct point_p *p, struct point_c *c,
+	unsigned int count)
 {
+	polar_ivec bad = {0};
+	unsigned int i;
+	unsigned int j;
 	int fe_err;
-	float rad = deg_to_rad(p->t);
 
-	errno = 0;
 	feclearexcept(FE_ALL_EXCEPT);
 
-	c->x = p->r * cosf(rad);
-	fe_err = fetestexcept(FE_INVALID);
+	for (i = 0; i < count; i += polar_batch) {
+		const unsigned int n = (count - i < polar_batch)
+			? count - i : polar_batch;
+		polar_vec r = {0};
+		polar_vec t = {0};
+		polar_vec x;
+		polar_vec y;
 
-	c->y = p->r * sinf(rad);
-	fe_err |= fetestexcept(FE_INVALID);
+		for (j = 0; j < n; j++) {
+			r[j] = p[i + j].r;
+			t[j] = p[i + j].t;
+		}
 
-	if (errno || fe_err) {
-		error("Math error: %d (%s)\n", fe_err, strerror(errno));
+		bad |= polar_vec_to_cart(r, t, &x, &y);
+
+		for (j = 0; j < n; j++) {
+			c[i + j].x = x[j];
+			c[i + j].y = y[j];
+		}
+	}
+
+	for (j = 1; j < polar_batch; j++) {
+		bad[0] |= bad[j];
+	}
+
+	if (bad[0]) {
+		error("Angle out of range.\n");
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	fe_err = fetestexcept(FE_INVALID);
+
+	if (fe_err) {
+		error("Math error: %d\n", fe_err);
 		assert(0);
 		exit(EXIT_FAILURE);
 	}
+}
 
+struct point_c *polar_to_cart(const struct point_p *p, struct point_c *c)
+{
+	polar_to_cart_n(p, c, 1);
 	return c;
 }
 
@@ -88,12 +192,12 @@ void debug_print_line(const char *msg, const struct line_c *line)
 	debug("%sslope     = %f deg\n", msg, rad_to_deg(line->slope));
 	debug("%sintercept = %f\n", msg, line->intercept);
 
-	if (svg_debug_stream()) {
+	if (svg_debug_writer()) {
 		struct svg_line sl;
 
 		sl.a = line->a;
 		sl.b = line->b;
-		svg_write_line(svg_debug_stream(), &svg_style_red_red, NULL,
+		svg_write_line(svg_debug_writer(), &svg_style_red_red, NULL,
 			msg, &sl);
 	}
 }
@@ -131,6 +235,392 @@ struct point_c line_intersection(const struct line_c *line1,
 	return i;
 }
 
+/*
+ * polygon_contains_point - Even-odd test of p against the closed polygon.
+ * Points on an edge may go either way.
+ */
+
+bool polygon_contains_point(const struct point_c *poly, unsigned int count,
+	const struct point_c *p)
+{
+	bool inside = false;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0, j = count - 1; i < count; j = i++) {
+		const struct point_c *a = &poly[i];
+		const struct point_c *b = &poly[j];
+
+		if ((a->y > p->y) != (b->y > p->y)
+			&& p->x < (b->x - a->x) * (p->y - a->y) / (b->y - a->y)
+				+ a->x) {
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+static float segment_distance(const struct point_c *a,
+	const struct point_c *b, const struct point_c *p)
+{
+	const float dx = b->x - a->x;
+	const float dy = b->y - a->y;
+	const float len2 = dx * dx + dy * dy;
+	float t = 0.0;
+
+	if (len2 > 0.0) {
+		t = ((p->x - a->x) * dx + (p->y - a->y) * dy) / len2;
+		t = (t < 0.0) ? 0.0 : (t > 1.0) ? 1.0 : t;
+	}
+	return hypotf(a->x + t * dx - p->x, a->y + t * dy - p->y);
+}
+
+/* polygon_edge_distance - Distance from p to the nearest polygon edge. */
+
+float polygon_edge_distance(const struct point_c *poly, unsigned int count,
+	const struct point_c *p)
+{
+	float d = HUGE_VALF;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0, j = count - 1; i < count; j = i++) {
+		d = min_f(d, segment_distance(&poly[j], &poly[i], p));
+	}
+	return d;
+}
+
+static float cross(const struct point_c *o, const struct point_c *a,
+	const struct point_c *b)
+{
+	return (a->x - o->x) * (b->y - o->y) - (a->y - o->y) * (b->x - o->x);
+}
+
+/* segments_touch - True if segments ab and cd cross or touch. */
+
+static bool segments_touch(const struct point_c *a, const struct point_c *b,
+	const struct point_c *c, const struct point_c *d)
+{
+	const float d1 = cross(c, d, a);
+	const float d2 = cross(c, d, b);
+	const float d3 = cross(a, b, c);
+	const float d4 = cross(a, b, d);
+
+	if (((d1 > 0.0 && d2 > 0.0) || (d1 < 0.0 && d2 < 0.0))
+		|| ((d3 > 0.0 && d4 > 0.0) || (d3 < 0.0 && d4 < 0.0))) {
+		return false;
+	}
+
+	// Collinear segments only touch if their extents overlap.
+	if (!d1 && !d2 && !d3 && !d4) {
+		return min_f(a->x, b->x) <= max_f(c->x, d->x)
+			&& min_f(c->x, d->x) <= max_f(a->x, b->x)
+			&& min_f(a->y, b->y) <= max_f(c->y, d->y)
+			&& min_f(c->y, d->y) <= max_f(a->y, b->y);
+	}
+	return true;
+}
+
+/*
+ * polygon_contains_polygon - Conservative test that inner lies inside
+ * outer: every inner vertex is inside outer and no edges cross or touch.
+ * Borderline cases answer false.
+ */
+
+bool polygon_contains_polygon(const struct point_c *outer,
+	unsigned int outer_count, const struct point_c *inner,
+	unsigned int inner_count)
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	unsigned int l;
+
+	for (i = 0; i < inner_count; i++) {
+		if (!polygon_contains_point(outer, outer_count, &inner[i])) {
+			return false;
+		}
+	}
+
+	for (i = 0, j = inner_count - 1; i < inner_count; j = i++) {
+		for (k = 0, l = outer_count - 1; k < outer_count; l = k++) {
+			if (segments_touch(&inner[j], &inner[i], &outer[l],
+				&outer[k])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/* polygon_is_simple - True if no two non-adjacent edges cross or touch. */
+
+bool polygon_is_simple(const struct point_c *poly, unsigned int count)
+{
+	unsigned int i;
+	unsigned int k;
+
+	for (i = 0; i < count; i++) {
+		const struct point_c *a = &poly[i];
+		const struct point_c *b = &poly[(i + 1) % count];
+
+		for (k = i + 2; k < count; k++) {
+			if (!i && k == count - 1) {
+				continue;
+			}
+			if (segments_touch(a, b, &poly[k],
+				&poly[(k + 1) % count])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool polygon_touches_box(const struct point_c *poly,
+	unsigned int count, const struct point_c box[4])
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+
+	for (i = 0, j = count - 1; i < count; j = i++) {
+		for (k = 0; k < 4; k++) {
+			if (segments_touch(&poly[j], &poly[i], &box[k],
+				&box[(k + 1) % 4])) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void box_corners(float x0, float y0, float x1, float y1,
+	struct point_c box[4])
+{
+	box[0].x = x0;
+	box[0].y = y0;
+	box[1].x = x1;
+	box[1].y = y0;
+	box[2].x = x1;
+	box[2].y = y1;
+	box[3].x = x0;
+	box[3].y = y1;
+}
+
+/*
+ * polygon_contains_box - Conservative test that the box x0,y0 - x1,y1 lies
+ * inside the polygon: its corners are inside and no edges cross or touch.
+ */
+
+bool polygon_contains_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1)
+{
+	struct point_c box[4];
+	unsigned int k;
+
+	box_corners(x0, y0, x1, y1, box);
+
+	for (k = 0; k < 4; k++) {
+		if (!polygon_contains_point(poly, count, &box[k])) {
+			return false;
+		}
+	}
+	return !polygon_touches_box(poly, count, box);
+}
+
+/*
+ * polygon_meets_box - Conservative test that the simple polygon and the box
+ * x0,y0 - x1,y1 overlap.  Borderline cases answer true.
+ */
+
+bool polygon_meets_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1)
+{
+	struct point_c box[4];
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (poly[i].x >= x0 && poly[i].x <= x1
+			&& poly[i].y >= y0 && poly[i].y <= y1) {
+			return true;
+		}
+	}
+
+	box_corners(x0, y0, x1, y1, box);
+
+	return polygon_contains_point(poly, count, &box[0])
+		|| polygon_touches_box(poly, count, box);
+}
+
+void polygon_bounds(const struct point_c *poly, unsigned int count,
+	struct point_c *min, struct point_c *max)
+{
+	unsigned int i;
+
+	min->x = max->x = poly[0].x;
+	min->y = max->y = poly[0].y;
+
+	for (i = 1; i < count; i++) {
+		min->x = min_f(min->x, poly[i].x);
+		min->y = min_f(min->y, poly[i].y);
+		max->x = max_f(max->x, poly[i].x);
+		max->y = max_f(max->y, poly[i].y);
+	}
+}
+
+/*
+ * Clipping.  Sutherland-Hodgman against the four sides of the box in turn,
+ * passing the nodes back and forth between the two halves of a clip_buffer.
+ * Against one side only an edge coming back in adds a node, so n nodes
+ * give at most n + n / 2 + 1.
+ */
+
+enum clip_side {
+	clip_left,
+	clip_right,
+	clip_bottom,
+	clip_top,
+	clip_side_count,
+};
+
+static bool clip_inside(const struct point_c *p, enum clip_side side,
+	float edge)
+{
+	switch (side) {
+	case clip_left:
+		return p->x >= edge;
+	case clip_right:
+		return p->x <= edge;
+	case clip_bottom:
+		return p->y >= edge;
+	default:
+		return p->y <= edge;
+	}
+}
+
+static struct point_c clip_cross(const struct point_c *a,
+	const struct point_c *b, enum clip_side side, float edge)
+{
+	struct point_c c;
+
+	if (side == clip_left || side == clip_right) {
+		c.x = edge;
+		c.y = a->y + (b->y - a->y) * (edge - a->x) / (b->x - a->x);
+	} else {
+		c.x = a->x + (b->x - a->x) * (edge - a->y) / (b->y - a->y);
+		c.y = edge;
+	}
+	return c;
+}
+
+static void clip_buffer_reserve(struct clip_buffer *cb, unsigned int half,
+	unsigned int count)
+{
+	if (cb->size[half] >= count) {
+		return;
+	}
+
+	if (cb->nodes[half]) {
+		mem_free(cb->nodes[half]);
+	}
+	cb->size[half] = count + count / 2;
+	cb->nodes[half] = mem_alloc(cb->size[half] * sizeof(*cb->nodes[half]));
+}
+
+static unsigned int clip_side(const struct point_c *in, unsigned int count,
+	enum clip_side side, float edge, struct point_c *out)
+{
+	const struct point_c *prev = &in[count - 1];
+	bool prev_inside = clip_inside(prev, side, edge);
+	unsigned int out_count = 0;
+	unsigned int i;
+
+	for (i = 0; i < count; prev = &in[i], i++) {
+		const bool inside = clip_inside(&in[i], side, edge);
+
+		if (inside != prev_inside) {
+			out[out_count++] = clip_cross(prev, &in[i], side, edge);
+		}
+		if (inside) {
+			out[out_count++] = in[i];
+		}
+		prev_inside = inside;
+	}
+	return out_count;
+}
+
+static float polygon_area2(const struct point_c *poly, unsigned int count)
+{
+	float area = 0.0;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		const struct point_c *b = &poly[(i + 1) % count];
+
+		area += poly[i].x * b->y - b->x * poly[i].y;
+	}
+	return area;
+}
+
+void clip_buffer_clean(struct clip_buffer *cb)
+{
+	unsigned int half;
+
+	for (half = 0; half < 2; half++) {
+		if (cb->nodes[half]) {
+			mem_free(cb->nodes[half]);
+		}
+	}
+}
+
+/*
+ * polygon_clip_box - Clip the polygon to the box x0,y0 - x1,y1.  Sets
+ * *clipped to poly itself when its bounding box is inside, else to the
+ * clipped nodes in cb, good until the next call.  Returns the clipped node
+ * count, 0 when nothing of the polygon is left.
+ */
+
+unsigned int polygon_clip_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1, struct clip_buffer *cb,
+	const struct point_c **clipped)
+{
+	const float edges[clip_side_count] = {x0, x1, y0, y1};
+	const struct point_c *in = poly;
+	struct point_c min;
+	struct point_c max;
+	unsigned int side;
+
+	*clipped = poly;
+
+	if (count < 3) {
+		return 0;
+	}
+
+	polygon_bounds(poly, count, &min, &max);
+
+	if (max.x < x0 || min.x > x1 || max.y < y0 || min.y > y1) {
+		return 0;
+	}
+	if (min.x >= x0 && max.x <= x1 && min.y >= y0 && max.y <= y1) {
+		return count;
+	}
+
+	for (side = 0; side < clip_side_count && count; side++) {
+		const unsigned int half = side % 2;
+
+		clip_buffer_reserve(cb, half, count + count / 2 + 1);
+		count = clip_side(in, count, side, edges[side],
+			cb->nodes[half]);
+		in = cb->nodes[half];
+	}
+
+	*clipped = in;
+
+	// What is left may be a sliver along the box.
+	return (count >= 3 && polygon_area2(in, count) != 0.0) ? count : 0;
+}
+
 void polygon_star_init(const struct star_params *star_params,
 	struct polygon_star *ps)
 {
@@ -184,24 +674,1383 @@ void polygon_star_init(const struct star_params *star_params,
 void polygon_star_generate(const struct polygon_star *ps,
 	struct node_buffer *nb)
 {
+	struct point_p *polar;
 	struct point_p p;
 	unsigned int node;
 
 	nb->node_count = 2.0 * ps->points;
-	nb->nodes = mem_alloc(nb->node_count * sizeof(*nb->nodes));
+	nb->nodes = mem_alloc_uninit(nb->node_count * sizeof(*nb->nodes));
+	polar = mem_alloc_uninit(nb->node_count * sizeof(*polar));
 
 	for (node = 0, p.r = ps->radius, p.t = ps->rotation;
 		node < nb->node_count;
 		node++, p.t += ps->sector_angle,
 		p.r = (node % 2) ? ps->inner_radius : ps->radius) {
-		polar_to_cart(&p, &nb->nodes[node]);
+		polar[node] = p;
+	}
 
+	polar_to_cart_n(polar, nb->nodes, nb->node_count);
+
+	for (node = 0; node < nb->node_count; node++) {
 		debug("node_%u: polar = {%f, %f},\tcart = {%f, %f}\n",
-			node, p.t, p.r, nb->nodes[node].x, nb->nodes[node].y);
+			node, polar[node].t, polar[node].r,
+			nb->nodes[node].x, nb->nodes[node].y);
 	}
+
+	mem_free(polar);
 }
 
 void node_buffer_clean(struct node_buffer *nb)
 {
 	mem_free(nb->nodes);
 }
+
+/*
+ * Simplification.  Ramer-Douglas-Peucker on a closed polygon, split first
+ * at node 0 and the node farthest from it.  A range whose nodes all lie
+ * within tolerance of its chord loses them, else it splits at its farthest
+ * node.  The shorter part is done first and the longer one stacked, so the
+ * stack never holds more than 2 + log2(count) ranges.  Dropped nodes are
+ * marked NAN and squeezed out at the end.
+ */
+
+enum {simplify_stack_size = 64};
+
+struct simplify_range {
+	unsigned int first;
+	unsigned int last;	// taken modulo count.
+};
+
+/*
+ * simplify_farthest - The node between first and last farthest from the
+ * chord joining them, first if there is none.
+ */
+
+static unsigned int simplify_farthest(const struct point_c *nodes,
+	unsigned int count, const struct simplify_range *range,
+	float *distance)
+{
+	const struct point_c *a = &nodes[range->first];
+	const struct point_c *b = &nodes[range->last % count];
+	unsigned int farthest = range->first;
+	unsigned int i;
+
+	*distance = 0.0;
+	for (i = range->first + 1; i < range->last; i++) {
+		const float d = segment_distance(a, b, &nodes[i]);
+
+		if (d > *distance) {
+			*distance = d;
+			farthest = i;
+		}
+	}
+	return farthest;
+}
+
+/*
+ * polygon_simplify - Drop the nodes of the closed polygon that lie within
+ * tolerance of the simplified outline, in place.  Adds to stats and returns
+ * the new node count.  A polygon that would collapse to a line is kept.
+ */
+
+unsigned int polygon_simplify(struct point_c *nodes, unsigned int count,
+	float tolerance, struct simplify_stats *stats)
+{
+	struct simplify_range stack[simplify_stack_size];
+	struct simplify_range range;
+	unsigned int depth = 0;
+	unsigned int split = 0;
+	float deviation = 0.0;
+	float d_split = 0.0;
+	float d0;
+	float d1;
+	unsigned int kept;
+	unsigned int i;
+
+	stats->node_count += count;
+
+	if (count < 4 || !(tolerance > 0.0)) {
+		return count;
+	}
+
+	for (i = 1; i < count; i++) {
+		const float d = hypotf(nodes[i].x - nodes[0].x,
+			nodes[i].y - nodes[0].y);
+
+		if (d > d_split) {
+			d_split = d;
+			split = i;
+		}
+	}
+
+	stack[0].first = 0;
+	stack[0].last = split;
+	stack[1].first = split;
+	stack[1].last = count;
+	simplify_farthest(nodes, count, &stack[0], &d0);
+	simplify_farthest(nodes, count, &stack[1], &d1);
+
+	if (!split || (d0 <= tolerance && d1 <= tolerance)) {
+		return count;
+	}
+
+	for (depth = 2; depth; ) {
+		range = stack[--depth];
+
+		while (range.last - range.first > 1) {
+			float d;
+			const unsigned int m = simplify_farthest(nodes, count,
+				&range, &d);
+
+			if (d <= tolerance) {
+				for (i = range.first + 1; i < range.last; i++) {
+					nodes[i].x = NAN;
+				}
+				deviation = max_f(deviation, d);
+				break;
+			}
+
+			assert(depth < simplify_stack_size);
+			stack[depth] = range;
+			if (m - range.first > range.last - m) {
+				stack[depth++].last = m;
+				range.first = m;
+			} else {
+				stack[depth++].first = m;
+				range.last = m;
+			}
+		}
+	}
+
+	for (i = 0, kept = 0; i < count; i++) {
+		if (!isnan(nodes[i].x)) {
+			nodes[kept++] = nodes[i];
+		}
+	}
+
+	stats->removed += count - kept;
+	stats->max_deviation = max_f(stats->max_deviation, deviation);
+	return kept;
+}
+
+void node_buffer_simplify(struct node_buffer *nb, float tolerance,
+	struct simplify_stats *stats)
+{
+	nb->node_count = polygon_simplify(nb->nodes, nb->node_count,
+		tolerance, stats);
+}
+
+enum {unit_star_cache_size = 16};
+
+struct unit_star {
+	unsigned int points;	// 0 for an empty entry.
+	unsigned int density;
+	float inner_ratio;	// inner radius / radius.
+	struct point_c nodes[2 * unit_star_points_max];
+};
+
+static __thread struct unit_star unit_star_cache[unit_star_cache_size];
+
+/*
+ * unit_star_get - Unit star of radius 1 and rotation 0.  The cache is
+ * direct mapped, a miss recomputes the entry in place.
+ */
+
+static const struct unit_star *unit_star_get(unsigned int points,
+	unsigned int density)
+{
+	struct unit_star *us = &unit_star_cache[(points * 7U + density)
+		% unit_star_cache_size];
+	struct point_p polar[2 * unit_star_points_max];
+	struct star_params sp;
+	struct polygon_star ps;
+	unsigned int node;
+
+	assert(points && points <= unit_star_points_max);
+
+	if (us->points == points && us->density == density) {
+		return us;
+	}
+
+	sp.points = points;
+	sp.density = density;
+	sp.radius = 1.0;
+	sp.rotation = 0.0;
+	polygon_star_init(&sp, &ps);
+
+	for (node = 0; node < 2 * points; node++) {
+		polar[node].r = (node % 2) ? ps.inner_radius : 1.0;
+		polar[node].t = node * ps.sector_angle;
+	}
+	polar_to_cart_n(polar, us->nodes, 2 * points);
+
+	us->points = points;
+	us->density = density;
+	us->inner_ratio = ps.inner_radius;
+	return us;
+}
+
+unsigned int star_place(const struct star_params *star_params,
+	struct point_c *nodes)
+{
+	const struct unit_star *us;
+	struct point_p rotation;
+	struct point_c r;
+	unsigned int node;
+
+	if (!star_params->points
+		|| star_params->points > unit_star_points_max) {
+		return 0;
+	}
+
+	us = unit_star_get(star_params->points, star_params->density);
+
+	// r is the rotation scaled by the radius.
+	rotation.r = star_params->radius;
+	rotation.t = star_params->rotation;
+	polar_to_cart(&rotation, &r);
+
+	for (node = 0; node < 2 * us->points; node++) {
+		const struct point_c u = us->nodes[node];
+
+		nodes[node].x = u.x * r.x - u.y * r.y;
+		nodes[node].y = u.x * r.y + u.y * r.x;
+	}
+
+	return 2 * us->points;
+}
+
+/*
+ * Planar flattening.  A Bentley-Ottmann sweep over all polygon edges finds
+ * their k crossings in O((n + k) log n), with a treap as the sweep status
+ * and a binary heap of events.  The edges split at the crossings form a
+ * planar graph, whose faces are traced from the angular order of the edges
+ * around each vertex.
+ *
+ * Crossing an edge changes the winding number of its polygon by one, so
+ * the windings of all faces of a connected part of the graph follow from
+ * a walk outward from its outer face.  That face lies in the face the
+ * sweep found just below the leftmost vertex of the part, and parts are
+ * walked in order of leftmost vertex, so it is always known.  A face is
+ * owned by the last polygon with a nonzero winding there, and faces whose
+ * owners have the same key that share an edge merge into a region.
+ *
+ * Everything runs in double precision.  Only proper crossings are split,
+ * edges that meet at a vertex or overlap are kept as they are.
+ */
+
+enum {flat_none = UINT_MAX};
+
+struct flat_point {
+	double x;
+	double y;
+};
+
+struct flat_seg {
+	struct flat_point p;	// left end.
+	struct flat_point q;	// right end.
+	unsigned int p_vert;
+	unsigned int q_vert;
+	unsigned int poly;
+	bool forward;		// the polygon runs from p to q.
+	unsigned int node;	// status node.
+	unsigned int below;	// segment below p when inserted.
+	unsigned int edge;	// first graph edge.
+	unsigned int edge_count;
+};
+
+struct flat_node {
+	unsigned int seg;
+	unsigned int parent;
+	unsigned int left;
+	unsigned int right;
+	unsigned int priority;
+};
+
+enum flat_event_kind {
+	flat_event_cross,
+	flat_event_end,
+	flat_event_start,
+};
+
+struct flat_event {
+	struct flat_point p;
+	enum flat_event_kind kind;
+	unsigned int a;
+	unsigned int b;
+};
+
+struct flat_split {
+	unsigned int seg;
+	unsigned int vert;
+};
+
+/*
+ * The segment ends are sorted once into ends, crossings found on the way
+ * go through the events heap.  Vertices are numbered as the sweep reaches
+ * them, so in sweep order, and the crossings of each segment are recorded
+ * in order along it.
+ */
+
+struct flat_sweep {
+	struct flat_seg *segs;
+	unsigned int seg_count;
+	struct flat_node *nodes;
+	unsigned int root;
+	struct flat_event *ends;
+	unsigned int end_count;
+	struct flat_event *events;
+	unsigned int event_count;
+	unsigned int event_size;
+	struct flat_split *splits;
+	unsigned int split_count;
+	unsigned int split_size;
+	struct flat_point *verts;
+	unsigned int vert_count;
+	unsigned int vert_size;
+	struct flat_point at;	// current event point.
+};
+
+static int flat_point_cmp(const struct flat_point *a,
+	const struct flat_point *b)
+{
+	if (a->x != b->x) {
+		return (a->x < b->x) ? -1 : 1;
+	}
+	if (a->y != b->y) {
+		return (a->y < b->y) ? -1 : 1;
+	}
+	return 0;
+}
+
+static double flat_orient(const struct flat_point *a,
+	const struct flat_point *b, const struct flat_point *c)
+{
+	return (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+}
+
+static bool flat_event_less(const struct flat_event *a,
+	const struct flat_event *b)
+{
+	const int c = flat_point_cmp(&a->p, &b->p);
+
+	return c ? (c < 0) : (a->kind < b->kind);
+}
+
+static int flat_event_qcmp(const void *a, const void *b)
+{
+	const struct flat_event *ea = a;
+	const struct flat_event *eb = b;
+
+	return flat_event_less(ea, eb) ? -1 : flat_event_less(eb, ea);
+}
+
+static void flat_event_push(struct flat_sweep *sw,
+	const struct flat_event *event)
+{
+	unsigned int i;
+
+	sw->events = vector_grow(sw->events, &sw->event_size,
+		sw->event_count + 1, sizeof(*sw->events));
+
+	for (i = sw->event_count++; i; ) {
+		const unsigned int parent = (i - 1) / 2;
+
+		if (!flat_event_less(event, &sw->events[parent])) {
+			break;
+		}
+		sw->events[i] = sw->events[parent];
+		i = parent;
+	}
+	sw->events[i] = *event;
+}
+
+static void flat_event_pop(struct flat_sweep *sw, struct flat_event *event)
+{
+	const struct flat_event last = sw->events[--sw->event_count];
+	unsigned int i = 0;
+
+	*event = sw->events[0];
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+
+		if (child >= sw->event_count) {
+			break;
+		}
+		if (child + 1 < sw->event_count
+			&& flat_event_less(&sw->events[child + 1],
+				&sw->events[child])) {
+			child++;
+		}
+		if (!flat_event_less(&sw->events[child], &last)) {
+			break;
+		}
+		sw->events[i] = sw->events[child];
+		i = child;
+	}
+	sw->events[i] = last;
+}
+
+static double flat_y_at(const struct flat_seg *s, const struct flat_point *at)
+{
+	if (s->p.x == s->q.x) {
+		return (at->y < s->p.y) ? s->p.y
+			: (at->y > s->q.y) ? s->q.y : at->y;
+	}
+	return s->p.y + (s->q.y - s->p.y) * (at->x - s->p.x)
+		/ (s->q.x - s->p.x);
+}
+
+/* flat_above - True if n, starting at the sweep point, goes above s. */
+
+static bool flat_above(const struct flat_seg *n, const struct flat_seg *s,
+	const struct flat_point *at)
+{
+	const double y = flat_y_at(s, at);
+
+	if (y != n->p.y) {
+		return n->p.y > y;
+	}
+	return (s->q.x - s->p.x) * (n->q.y - n->p.y)
+		- (s->q.y - s->p.y) * (n->q.x - n->p.x) > 0.0;
+}
+
+static void status_link(struct flat_sweep *sw, unsigned int parent,
+	unsigned int old, unsigned int child)
+{
+	struct flat_node *n = sw->nodes;
+
+	if (parent == flat_none) {
+		sw->root = child;
+	} else if (n[parent].left == old) {
+		n[parent].left = child;
+	} else {
+		n[parent].right = child;
+	}
+	if (child != flat_none) {
+		n[child].parent = parent;
+	}
+}
+
+static void status_rotate_up(struct flat_sweep *sw, unsigned int x)
+{
+	struct flat_node *n = sw->nodes;
+	const unsigned int p = n[x].parent;
+
+	status_link(sw, n[p].parent, p, x);
+
+	if (n[p].left == x) {
+		n[p].left = n[x].right;
+		if (n[x].right != flat_none) {
+			n[n[x].right].parent = p;
+		}
+		n[x].right = p;
+	} else {
+		n[p].right = n[x].left;
+		if (n[x].left != flat_none) {
+			n[n[x].left].parent = p;
+		}
+		n[x].left = p;
+	}
+	n[p].parent = x;
+}
+
+static void status_insert(struct flat_sweep *sw, unsigned int x)
+{
+	struct flat_node *n = sw->nodes;
+	const struct flat_seg *seg = &sw->segs[n[x].seg];
+	unsigned int parent = flat_none;
+	unsigned int cur = sw->root;
+	bool above = false;
+
+	while (cur != flat_none) {
+		parent = cur;
+		above = flat_above(seg, &sw->segs[n[cur].seg], &sw->at);
+		cur = above ? n[cur].right : n[cur].left;
+	}
+
+	n[x].parent = parent;
+	n[x].left = n[x].right = flat_none;
+	if (parent == flat_none) {
+		sw->root = x;
+	} else if (above) {
+		n[parent].right = x;
+	} else {
+		n[parent].left = x;
+	}
+
+	while (n[x].parent != flat_none
+		&& n[n[x].parent].priority > n[x].priority) {
+		status_rotate_up(sw, x);
+	}
+}
+
+static void status_remove(struct flat_sweep *sw, unsigned int x)
+{
+	struct flat_node *n = sw->nodes;
+
+	while (n[x].left != flat_none || n[x].right != flat_none) {
+		const unsigned int l = n[x].left;
+		const unsigned int r = n[x].right;
+
+		status_rotate_up(sw, (l == flat_none) ? r : (r == flat_none)
+			? l : (n[l].priority < n[r].priority) ? l : r);
+	}
+	status_link(sw, n[x].parent, x, flat_none);
+}
+
+static unsigned int status_next(const struct flat_sweep *sw, unsigned int x)
+{
+	const struct flat_node *n = sw->nodes;
+
+	if (n[x].right != flat_none) {
+		for (x = n[x].right; n[x].left != flat_none; x = n[x].left) {
+		}
+		return x;
+	}
+	while (n[x].parent != flat_none && n[n[x].parent].right == x) {
+		x = n[x].parent;
+	}
+	return n[x].parent;
+}
+
+static unsigned int status_prev(const struct flat_sweep *sw, unsigned int x)
+{
+	const struct flat_node *n = sw->nodes;
+
+	if (n[x].left != flat_none) {
+		for (x = n[x].left; n[x].right != flat_none; x = n[x].right) {
+		}
+		return x;
+	}
+	while (n[x].parent != flat_none && n[n[x].parent].left == x) {
+		x = n[x].parent;
+	}
+	return n[x].parent;
+}
+
+/*
+ * flat_check - Queue the crossing of the neighbours lower and upper, if
+ * upper crosses down through lower.
+ */
+
+static void flat_check(struct flat_sweep *sw, unsigned int lower,
+	unsigned int upper)
+{
+	const unsigned int a = sw->nodes[lower].seg;
+	const unsigned int b = sw->nodes[upper].seg;
+	const struct flat_seg *sa = &sw->segs[a];
+	const struct flat_seg *sb = &sw->segs[b];
+	const double o1 = flat_orient(&sa->p, &sa->q, &sb->p);
+	const double o2 = flat_orient(&sa->p, &sa->q, &sb->q);
+	struct flat_event event;
+	struct flat_point at;
+	double t;
+
+	if (!(o1 > 0.0 && o2 < 0.0
+		&& flat_orient(&sb->p, &sb->q, &sa->p) < 0.0
+		&& flat_orient(&sb->p, &sb->q, &sa->q) > 0.0)) {
+		return;
+	}
+
+	t = o1 / (o1 - o2);
+	at.x = sb->p.x + t * (sb->q.x - sb->p.x);
+	at.y = sb->p.y + t * (sb->q.y - sb->p.y);
+
+	// Rounding may put it behind the sweep, take it as here then.
+	event.p = (flat_point_cmp(&at, &sw->at) < 0) ? sw->at : at;
+	event.kind = flat_event_cross;
+	event.a = a;
+	event.b = b;
+	flat_event_push(sw, &event);
+}
+
+static void flat_check_pair(struct flat_sweep *sw, unsigned int lower,
+	unsigned int upper)
+{
+	if (lower != flat_none && upper != flat_none) {
+		flat_check(sw, lower, upper);
+	}
+}
+
+/* flat_vertex - Number of the vertex at the current event point. */
+
+static unsigned int flat_vertex(struct flat_sweep *sw)
+{
+	if (sw->vert_count
+		&& !flat_point_cmp(&sw->verts[sw->vert_count - 1], &sw->at)) {
+		return sw->vert_count - 1;
+	}
+
+	sw->verts = vector_grow(sw->verts, &sw->vert_size,
+		sw->vert_count + 1, sizeof(*sw->verts));
+	sw->verts[sw->vert_count] = sw->at;
+	return sw->vert_count++;
+}
+
+static void flat_add_split(struct flat_sweep *sw, unsigned int seg,
+	unsigned int vert)
+{
+	sw->splits = vector_grow(sw->splits, &sw->split_size,
+		sw->split_count + 1, sizeof(*sw->splits));
+	sw->splits[sw->split_count].seg = seg;
+	sw->splits[sw->split_count++].vert = vert;
+}
+
+static void flat_cross(struct flat_sweep *sw, const struct flat_event *event)
+{
+	const unsigned int na = sw->segs[event->a].node;
+	const unsigned int nb = sw->segs[event->b].node;
+
+	// Stale if they are no longer neighbours in this order.
+	if (status_next(sw, na) != nb) {
+		return;
+	}
+
+	sw->nodes[na].seg = event->b;
+	sw->nodes[nb].seg = event->a;
+	sw->segs[event->a].node = nb;
+	sw->segs[event->b].node = na;
+
+	flat_add_split(sw, event->a, flat_vertex(sw));
+	flat_add_split(sw, event->b, flat_vertex(sw));
+
+	flat_check_pair(sw, status_prev(sw, na), na);
+	flat_check_pair(sw, nb, status_next(sw, nb));
+}
+
+static void flat_sweep_run(struct flat_sweep *sw)
+{
+	struct flat_event event;
+	unsigned int end = 0;
+	unsigned int i;
+
+	sw->root = flat_none;
+	sw->ends = mem_alloc((2 * sw->seg_count + 1) * sizeof(*sw->ends));
+
+	for (i = 0; i < sw->seg_count; i++) {
+		struct flat_event *e = &sw->ends[2 * i];
+
+		// Knuth multiplicative hash for the treap priorities.
+		sw->nodes[i].seg = i;
+		sw->nodes[i].priority = i * 2654435761U;
+		sw->segs[i].node = i;
+
+		e[0].p = sw->segs[i].p;
+		e[0].kind = flat_event_start;
+		e[0].a = e[0].b = i;
+		e[1].p = sw->segs[i].q;
+		e[1].kind = flat_event_end;
+		e[1].a = e[1].b = i;
+	}
+	sw->end_count = 2 * sw->seg_count;
+	qsort(sw->ends, sw->end_count, sizeof(*sw->ends), flat_event_qcmp);
+
+	while (end < sw->end_count || sw->event_count) {
+		unsigned int x;
+		unsigned int prev;
+		unsigned int next;
+
+		if (end < sw->end_count && (!sw->event_count
+			|| !flat_event_less(&sw->events[0], &sw->ends[end]))) {
+			event = sw->ends[end++];
+		} else {
+			flat_event_pop(sw, &event);
+		}
+		sw->at = event.p;
+
+		switch (event.kind) {
+		case flat_event_cross:
+			flat_cross(sw, &event);
+			break;
+		case flat_event_start:
+			sw->segs[event.a].p_vert = flat_vertex(sw);
+			x = sw->segs[event.a].node;
+			status_insert(sw, x);
+			prev = status_prev(sw, x);
+			sw->segs[event.a].below = (prev == flat_none)
+				? flat_none : sw->nodes[prev].seg;
+			flat_check_pair(sw, prev, x);
+			flat_check_pair(sw, x, status_next(sw, x));
+			break;
+		case flat_event_end:
+			sw->segs[event.a].q_vert = flat_vertex(sw);
+			x = sw->segs[event.a].node;
+			prev = status_prev(sw, x);
+			next = status_next(sw, x);
+			status_remove(sw, x);
+			flat_check_pair(sw, prev, next);
+			break;
+		default:
+			assert(0);
+		}
+	}
+
+	mem_free(sw->ends);
+}
+
+/*
+ * The planar graph.  Edge e runs from vertex u to v, left to right along
+ * its segment.  Half edge 2e is u to v, 2e + 1 is v to u, and each has the
+ * face to its left.
+ */
+
+struct flat_edge {
+	unsigned int u;
+	unsigned int v;
+	unsigned int seg;
+};
+
+struct flat_dir {
+	double dx;
+	double dy;
+	unsigned int h;
+};
+
+struct flat_wind {
+	unsigned int poly;
+	int wind;
+};
+
+struct flat_loop {
+	unsigned int start;	// first point.
+	unsigned int region;
+};
+
+struct flat_graph {
+	struct flat_point *verts;
+	unsigned int vert_count;
+	struct flat_edge *edges;
+	unsigned int edge_count;
+	struct flat_dir *out;		// half edges by origin and angle.
+	unsigned int *out_start;	// first out entry of each vertex.
+	unsigned int *pos;		// out entry of each half edge.
+	unsigned int *next;		// next half edge around the face.
+	unsigned int *face;		// face of each half edge.
+	unsigned int *face_first;	// a half edge of each face.
+	unsigned int face_count;
+	unsigned int *face_top;		// owner of each face.
+	unsigned int *face_key;		// merge key of the owner.
+	unsigned int *face_wind;	// first winds entry of each face.
+	unsigned int *face_wind_count;
+	struct flat_wind *winds;
+	unsigned int wind_count;
+	unsigned int wind_size;
+};
+
+static unsigned int flat_origin(const struct flat_graph *g, unsigned int h)
+{
+	const struct flat_edge *e = &g->edges[h / 2];
+
+	return (h & 1) ? e->v : e->u;
+}
+
+static void flat_add_edge(struct flat_graph *g, unsigned int u,
+	unsigned int v, unsigned int seg)
+{
+	struct flat_edge *e;
+
+	if (u == v) {
+		return;
+	}
+	e = &g->edges[g->edge_count++];
+	e->u = u;
+	e->v = v;
+	e->seg = seg;
+}
+
+static int flat_dir_half(const struct flat_dir *d)
+{
+	return d->dy < 0.0 || (d->dy == 0.0 && d->dx < 0.0);
+}
+
+static int flat_dir_cmp(const struct flat_dir *da, const struct flat_dir *db)
+{
+	const int ha = flat_dir_half(da);
+	const int hb = flat_dir_half(db);
+	double c;
+
+	if (ha != hb) {
+		return ha - hb;
+	}
+	c = da->dx * db->dy - da->dy * db->dx;
+	if (c != 0.0) {
+		return (c > 0.0) ? -1 : 1;
+	}
+	return (da->h < db->h) ? -1 : (da->h > db->h);
+}
+
+/* flat_graph_build - Vertices, edges and faces from the swept segments. */
+
+static void flat_graph_build(struct flat_graph *g, struct flat_sweep *sw)
+{
+	unsigned int *split_start;
+	unsigned int *split_vert;
+	unsigned int half_count;
+	unsigned int i;
+	unsigned int k;
+
+	g->verts = sw->verts;
+	g->vert_count = sw->vert_count;
+	sw->verts = NULL;
+
+	// The crossings of each segment, kept in their order along it.
+	split_start = mem_alloc((sw->seg_count + 1) * sizeof(*split_start));
+	split_vert = mem_alloc((sw->split_count + 1) * sizeof(*split_vert));
+	for (i = 0; i < sw->split_count; i++) {
+		split_start[sw->splits[i].seg + 1]++;
+	}
+	for (i = 0; i < sw->seg_count; i++) {
+		split_start[i + 1] += split_start[i];
+	}
+	for (i = 0; i < sw->split_count; i++) {
+		split_vert[split_start[sw->splits[i].seg]++] =
+			sw->splits[i].vert;
+	}
+
+	// Each segment is cut into edges at its crossings.
+	g->edges = mem_alloc((sw->seg_count + sw->split_count + 1)
+		* sizeof(*g->edges));
+	for (i = 0, k = 0; i < sw->seg_count; i++) {
+		struct flat_seg *s = &sw->segs[i];
+		unsigned int u = s->p_vert;
+
+		s->edge = g->edge_count;
+		for (; k < split_start[i]; k++) {
+			flat_add_edge(g, u, split_vert[k], i);
+			u = split_vert[k];
+		}
+		flat_add_edge(g, u, s->q_vert, i);
+		s->edge_count = g->edge_count - s->edge;
+	}
+
+	mem_free(split_vert);
+	mem_free(split_start);
+
+	// Half edges sorted by origin, then counterclockwise by angle.
+	half_count = 2 * g->edge_count;
+	g->out = mem_alloc((half_count + 1) * sizeof(*g->out));
+	g->out_start = mem_alloc((g->vert_count + 1) * sizeof(*g->out_start));
+	g->pos = mem_alloc((half_count + 1) * sizeof(*g->pos));
+	g->next = mem_alloc((half_count + 1) * sizeof(*g->next));
+	g->face = mem_alloc((half_count + 1) * sizeof(*g->face));
+	g->face_first = mem_alloc((half_count + 1) * sizeof(*g->face_first));
+
+	for (i = 0; i < half_count; i++) {
+		g->out_start[flat_origin(g, i) + 1]++;
+	}
+	for (i = 0; i < g->vert_count; i++) {
+		g->out_start[i + 1] += g->out_start[i];
+	}
+	for (i = 0; i < half_count; i++) {
+		const unsigned int o = flat_origin(g, i);
+		const unsigned int d = flat_origin(g, i ^ 1);
+		struct flat_dir *dir = &g->out[g->out_start[o] + g->pos[o]];
+
+		// pos counts the placed entries of each vertex for now.
+		g->pos[o]++;
+		dir->dx = g->verts[d].x - g->verts[o].x;
+		dir->dy = g->verts[d].y - g->verts[o].y;
+		dir->h = i;
+	}
+	// Most vertices have two or four, an insertion sort does.
+	for (i = 0; i < g->vert_count; i++) {
+		for (k = g->out_start[i] + 1; k < g->out_start[i + 1]; k++) {
+			const struct flat_dir dir = g->out[k];
+			unsigned int j;
+
+			for (j = k; j > g->out_start[i]
+				&& flat_dir_cmp(&dir, &g->out[j - 1]) < 0; j--) {
+				g->out[j] = g->out[j - 1];
+			}
+			g->out[j] = dir;
+		}
+	}
+	for (i = 0; i < half_count; i++) {
+		g->pos[g->out[i].h] = i;
+	}
+
+	// The face left of h turns at its end onto the clockwise neighbour
+	// of its twin.
+	for (i = 0; i < half_count; i++) {
+		const unsigned int twin = g->pos[i ^ 1];
+		const unsigned int v = flat_origin(g, i ^ 1);
+		const unsigned int prev = (twin == g->out_start[v])
+			? g->out_start[v + 1] - 1 : twin - 1;
+
+		g->next[i] = g->out[prev].h;
+	}
+
+	for (i = 0; i < half_count; i++) {
+		g->face[i] = flat_none;
+	}
+	for (i = 0, g->face_count = 0; i < half_count; i++) {
+		unsigned int h = i;
+
+		if (g->face[i] != flat_none) {
+			continue;
+		}
+		do {
+			g->face[h] = g->face_count;
+			h = g->next[h];
+		} while (h != i);
+		g->face_first[g->face_count++] = i;
+	}
+}
+
+/*
+ * flat_wind_copy - Give face to the windings of face from, with polygon
+ * poly changed by delta.
+ */
+
+static void flat_wind_copy(struct flat_graph *g, unsigned int to,
+	unsigned int from, unsigned int poly, int delta)
+{
+	const unsigned int first = g->face_wind[from];
+	const unsigned int count = g->face_wind_count[from];
+	bool done = (poly == flat_none);
+	unsigned int i;
+
+	g->winds = vector_grow(g->winds, &g->wind_size,
+		g->wind_count + count + 1, sizeof(*g->winds));
+
+	g->face_wind[to] = g->wind_count;
+
+	for (i = 0; i <= count; i++) {
+		const struct flat_wind *w = (i < count)
+			? &g->winds[first + i] : NULL;
+
+		if (!done && (!w || w->poly >= poly)) {
+			const int wind = ((w && w->poly == poly) ? w->wind : 0)
+				+ delta;
+
+			done = true;
+			if (wind) {
+				g->winds[g->wind_count].poly = poly;
+				g->winds[g->wind_count++].wind = wind;
+			}
+			if (w && w->poly == poly) {
+				continue;
+			}
+		}
+		if (w) {
+			g->winds[g->wind_count++] = *w;
+		}
+	}
+
+	g->face_wind_count[to] = g->wind_count - g->face_wind[to];
+}
+
+/*
+ * flat_outside - The face of another part that holds the part with leftmost
+ * vertex v, or flat_none if it is outside everything.
+ */
+
+static unsigned int flat_outside(const struct flat_graph *g,
+	const struct flat_sweep *sw, unsigned int v)
+{
+	const struct flat_point *pv = &g->verts[v];
+	unsigned int i;
+
+	for (i = g->out_start[v]; i < g->out_start[v + 1]; i++) {
+		const struct flat_seg *s = &sw->segs[g->edges[g->out[i].h / 2].seg];
+		const struct flat_seg *b;
+		unsigned int lo;
+		unsigned int hi;
+
+		if (s->below == flat_none) {
+			return flat_none;
+		}
+		b = &sw->segs[s->below];
+		if (b->p_vert == v || !b->edge_count) {
+			continue;
+		}
+
+		// The edge of b over the x of v, left of its rightward half.
+		lo = b->edge;
+		hi = b->edge + b->edge_count - 1;
+		while (lo < hi) {
+			const unsigned int mid = (lo + hi) / 2;
+
+			if (g->verts[g->edges[mid].v].x >= pv->x) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		return g->face[2 * lo];
+	}
+	return flat_none;
+}
+
+/*
+ * flat_wind_faces - Windings and owner of every face.  Returns in outer[f]
+ * the face that holds the part whose outer face is f, else flat_none.
+ */
+
+static void flat_wind_faces(struct flat_graph *g, const struct flat_sweep *sw,
+	unsigned int *outer)
+{
+	unsigned int *parts = mem_alloc((g->vert_count + 1) * sizeof(*parts));
+	unsigned int *queue = mem_alloc((g->face_count + 1) * sizeof(*queue));
+	unsigned int i;
+
+	g->face_top = mem_alloc((g->face_count + 1) * sizeof(*g->face_top));
+	g->face_wind = mem_alloc((g->face_count + 1) * sizeof(*g->face_wind));
+	g->face_wind_count = mem_alloc((g->face_count + 1)
+		* sizeof(*g->face_wind_count));
+
+	for (i = 0; i < g->face_count; i++) {
+		g->face_wind[i] = flat_none;
+		outer[i] = flat_none;
+	}
+
+	// Connected parts of the vertices.
+	for (i = 0; i < g->vert_count; i++) {
+		parts[i] = i;
+	}
+	for (i = 0; i < g->edge_count; i++) {
+		unsigned int a = g->edges[i].u;
+		unsigned int b = g->edges[i].v;
+
+		while (parts[a] != a) {
+			a = parts[a] = parts[parts[a]];
+		}
+		while (parts[b] != b) {
+			b = parts[b] = parts[parts[b]];
+		}
+		parts[(a > b) ? a : b] = (a > b) ? b : a;
+	}
+
+	// The root of each part is its leftmost vertex.
+	for (i = 0; i < g->vert_count; i++) {
+		unsigned int head = 0;
+		unsigned int tail = 0;
+		unsigned int seed = flat_none;
+		double angle = -HUGE_VAL;
+		unsigned int holder;
+		unsigned int k;
+
+		if (parts[i] != i || g->out_start[i + 1] == g->out_start[i]) {
+			continue;
+		}
+		holder = flat_outside(g, sw, i);
+
+		// The outer face is left of the steepest edge out of v.
+		for (k = g->out_start[i]; k < g->out_start[i + 1]; k++) {
+			const double a = atan2(g->out[k].dy, g->out[k].dx);
+
+			if (a > angle) {
+				angle = a;
+				seed = g->face[g->out[k].h];
+			}
+		}
+
+		if (holder == flat_none || g->face_wind[holder] == flat_none) {
+			g->face_wind[seed] = g->wind_count;
+			g->face_wind_count[seed] = 0;
+		} else {
+			flat_wind_copy(g, seed, holder, flat_none, 0);
+			outer[seed] = holder;
+		}
+
+		queue[tail++] = seed;
+		while (head < tail) {
+			const unsigned int f = queue[head++];
+			unsigned int h = g->face_first[f];
+
+			do {
+				const unsigned int t = g->face[h ^ 1];
+				const struct flat_seg *s =
+					&sw->segs[g->edges[h / 2].seg];
+
+				// Left of the polygon's own direction winds
+				// one more than right of it.
+				if (g->face_wind[t] == flat_none) {
+					flat_wind_copy(g, t, f, s->poly,
+						(!(h & 1) == s->forward)
+						? -1 : 1);
+					queue[tail++] = t;
+				}
+				h = g->next[h];
+			} while (h != g->face_first[f]);
+		}
+	}
+
+	for (i = 0; i < g->face_count; i++) {
+		const unsigned int count = g->face_wind_count[i];
+
+		g->face_top[i] = (g->face_wind[i] == flat_none || !count)
+			? flat_none : g->winds[g->face_wind[i] + count - 1].poly;
+	}
+
+	mem_free(queue);
+	mem_free(parts);
+}
+
+static void flat_graph_clean(struct flat_graph *g)
+{
+	if (g->verts) {
+		mem_free(g->verts);
+	}
+	mem_free(g->edges);
+	mem_free(g->out);
+	mem_free(g->out_start);
+	mem_free(g->pos);
+	mem_free(g->next);
+	mem_free(g->face);
+	mem_free(g->face_first);
+	mem_free(g->face_top);
+	mem_free(g->face_key);
+	mem_free(g->face_wind);
+	mem_free(g->face_wind_count);
+	if (g->winds) {
+		mem_free(g->winds);
+	}
+}
+
+static unsigned int flat_find(unsigned int *sets, unsigned int i)
+{
+	while (sets[i] != i) {
+		i = sets[i] = sets[sets[i]];
+	}
+	return i;
+}
+
+static bool flat_boundary(const struct flat_graph *g, unsigned int h)
+{
+	const unsigned int key = g->face_key[g->face[h]];
+
+	return key != flat_none && key != g->face_key[g->face[h ^ 1]];
+}
+
+/*
+ * flat_regions - Trace the boundary loops of the merged faces into result,
+ * grouped by region.
+ */
+
+static void flat_regions(const struct flat_graph *g, unsigned int *outer,
+	struct flatten_result *result)
+{
+	const unsigned int half_count = 2 * g->edge_count;
+	unsigned int *sets = outer;
+	unsigned int *region = mem_alloc((g->face_count + 1) * sizeof(*region));
+	struct flat_loop *loops = NULL;
+	unsigned int *loop_half;
+	unsigned int *order;
+	bool *done = mem_alloc((half_count + 1) * sizeof(*done));
+	struct point_c *points;
+	unsigned int point_size = 0;
+	unsigned int loop_size = 0;
+	unsigned int point_count = 0;
+	unsigned int loop_count = 0;
+	unsigned int region_count = 0;
+	unsigned int i;
+
+	// Reuse outer as the union find sets, a held outer face joins its
+	// holder.
+	for (i = 0; i < g->face_count; i++) {
+		sets[i] = (outer[i] == flat_none) ? i : outer[i];
+		region[i] = flat_none;
+	}
+	for (i = 0; i < g->edge_count; i++) {
+		const unsigned int a = g->face[2 * i];
+		const unsigned int b = g->face[2 * i + 1];
+
+		if (g->face_key[a] != flat_none
+			&& g->face_key[a] == g->face_key[b]) {
+			sets[flat_find(sets, a)] = flat_find(sets, b);
+		}
+	}
+
+	points = NULL;
+	loop_half = mem_alloc((half_count + 1) * sizeof(*loop_half));
+
+	for (i = 0; i < half_count; i++) {
+		const unsigned int root = flat_find(sets, g->face[i]);
+		unsigned int count = 0;
+		unsigned int first = point_count;
+		unsigned int h = i;
+		unsigned int k;
+
+		if (done[i] || !flat_boundary(g, i)) {
+			continue;
+		}
+
+		do {
+			done[h] = true;
+			loop_half[count++] = h;
+
+			// Step around the end vertex past merged edges.
+			for (h = g->next[h]; !flat_boundary(g, h);
+				h = g->next[h ^ 1]) {
+			}
+		} while (h != i);
+
+		// Drop vertices that only split one segment.
+		for (k = 0; k < count; k++) {
+			const unsigned int cur = loop_half[k];
+			const unsigned int prev =
+				loop_half[(k + count - 1) % count];
+			const struct flat_point *p =
+				&g->verts[flat_origin(g, cur)];
+
+			if (g->edges[cur / 2].seg == g->edges[prev / 2].seg) {
+				continue;
+			}
+			points = vector_grow(points, &point_size,
+				point_count + 1, sizeof(*points));
+			points[point_count].x = (float)p->x;
+			points[point_count++].y = (float)p->y;
+		}
+
+		if (point_count - first < 3) {
+			point_count = first;
+			continue;
+		}
+
+		if (region[root] == flat_none) {
+			region[root] = region_count++;
+		}
+		loops = vector_grow(loops, &loop_size,
+			loop_count + 1, sizeof(*loops));
+		loops[loop_count].start = first;
+		loops[loop_count++].region = region[root];
+	}
+
+	// Group the loops by region.
+	result->points = mem_alloc((point_count + 1) * sizeof(*result->points));
+	result->loops = mem_alloc((loop_count + 1) * sizeof(*result->loops));
+	result->regions = mem_alloc((region_count + 1)
+		* sizeof(*result->regions));
+	result->owners = mem_alloc((region_count + 1) * sizeof(*result->owners));
+	order = mem_alloc((loop_count + 1) * sizeof(*order));
+
+	for (i = 0; i < loop_count; i++) {
+		result->regions[loops[i].region + 1]++;
+	}
+	for (i = 0; i < region_count; i++) {
+		result->regions[i + 1] += result->regions[i];
+	}
+	for (i = 0; i < loop_count; i++) {
+		order[result->regions[loops[i].region]++] = i;
+	}
+	for (i = region_count; i; i--) {
+		result->regions[i] = result->regions[i - 1];
+	}
+	result->regions[0] = 0;
+
+	for (i = 0; i < g->face_count; i++) {
+		if (region[i] != flat_none) {
+			result->owners[region[i]] = g->face_top[i];
+		}
+	}
+
+	result->point_count = 0;
+	for (i = 0; i < loop_count; i++) {
+		const unsigned int l = order[i];
+		const unsigned int end = (l + 1 < loop_count)
+			? loops[l + 1].start : point_count;
+
+		result->loops[i] = result->point_count;
+		memcpy(result->points + result->point_count,
+			points + loops[l].start,
+			(end - loops[l].start) * sizeof(*points));
+		result->point_count += end - loops[l].start;
+	}
+	result->loops[loop_count] = result->point_count;
+	result->loop_count = loop_count;
+	result->region_count = region_count;
+
+	mem_free(order);
+	mem_free(loop_half);
+	if (points) {
+		mem_free(points);
+	}
+	if (loops) {
+		mem_free(loops);
+	}
+	mem_free(done);
+	mem_free(region);
+}
+
+void polygon_flatten(const struct point_c *points,
+	const unsigned int *offsets, const unsigned int *keys,
+	unsigned int count, struct flatten_result *result)
+{
+	struct flat_sweep sw;
+	struct flat_graph g;
+	unsigned int *outer;
+	unsigned int i;
+
+	memset(result, 0, sizeof(*result));
+	memset(&sw, 0, sizeof(sw));
+	memset(&g, 0, sizeof(g));
+
+	sw.segs = mem_alloc((offsets[count] + 1) * sizeof(*sw.segs));
+
+	for (i = 0; i < count; i++) {
+		const unsigned int first = offsets[i];
+		const unsigned int n = offsets[i + 1] - first;
+		unsigned int k;
+
+		for (k = 0; k < n; k++) {
+			const struct point_c *a = &points[first + k];
+			const struct point_c *b = &points[first + (k + 1) % n];
+			const struct flat_point pa = {a->x, a->y};
+			const struct flat_point pb = {b->x, b->y};
+			const int c = flat_point_cmp(&pa, &pb);
+			struct flat_seg *s = &sw.segs[sw.seg_count];
+
+			if (!c) {
+				continue;
+			}
+			s->p = (c < 0) ? pa : pb;
+			s->q = (c < 0) ? pb : pa;
+			s->poly = i;
+			s->forward = (c < 0);
+			s->below = flat_none;
+			sw.seg_count++;
+		}
+	}
+
+	sw.nodes = mem_alloc((sw.seg_count + 1) * sizeof(*sw.nodes));
+	flat_sweep_run(&sw);
+
+	flat_graph_build(&g, &sw);
+	outer = mem_alloc((g.face_count + 1) * sizeof(*outer));
+	flat_wind_faces(&g, &sw, outer);
+
+	g.face_key = mem_alloc((g.face_count + 1) * sizeof(*g.face_key));
+	for (i = 0; i < g.face_count; i++) {
+		const unsigned int top = g.face_top[i];
+
+		g.face_key[i] = (top == flat_none || !keys) ? top : keys[top];
+	}
+
+	flat_regions(&g, outer, result);
+
+	debug("%u edges, %u crossings, %u faces, %u regions.\n", sw.seg_count,
+		sw.split_count / 2, g.face_count, result->region_count);
+
+	mem_free(outer);
+	flat_graph_clean(&g);
+	mem_free(sw.nodes);
+	mem_free(sw.segs);
+	if (sw.events) {
+		mem_free(sw.events);
+	}
+	if (sw.splits) {
+		mem_free(sw.splits);
+	}
+}
+
+void flatten_result_clean(struct flatten_result *result)
+{
+	mem_free(result->points);
+	mem_free(result->loops);
+	mem_free(result->regions);
+	mem_free(result->owners);
+	memset(result, 0, sizeof(*result));
+}
@@ -5,6 +5,7 @@
 #if ! defined(_MD_GENERATOR_GEOMETRY_H)
 #define _MD_GENERATOR_GEOMETRY_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "log.h"
@@ -50,6 +51,8 @@ static inline float rad_to_deg(float rad)
 }
 
 struct point_c *polar_to_cart(const struct point_p *p, struct point_c *c);
+void polar_to_cart_n(const struct point_p *p, struct point_c *c,
+	unsigned int count);
 struct point_p *cart_to_polar(const struct point_c *c, struct point_p *p);
 
 static inline struct point_c *pc_polar_to_cart(struct point_pc *pc) {
@@ -101,6 +104,36 @@ static inline struct line_c *line_init(struct line_c *line,
 struct point_c line_intersection(const struct line_c *line1,
 	const struct line_c *line2);
 
+bool polygon_contains_point(const struct point_c *poly, unsigned int count,
+	const struct point_c *p);
+float polygon_edge_distance(const struct point_c *poly, unsigned int count,
+	const struct point_c *p);
+bool polygon_contains_polygon(const struct point_c *outer,
+	unsigned int outer_count, const struct point_c *inner,
+	unsigned int inner_count);
+bool polygon_is_simple(const struct point_c *poly, unsigned int count);
+bool polygon_contains_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1);
+bool polygon_meets_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1);
+void polygon_bounds(const struct point_c *poly, unsigned int count,
+	struct point_c *min, struct point_c *max);
+
+/*
+ * polygon_clip_box() clips a polygon to a box, Sutherland-Hodgman, into a
+ * clip_buffer that grows as needed.  Zero a clip_buffer to init it.
+ */
+
+struct clip_buffer {
+	struct point_c *nodes[2];
+	unsigned int size[2];
+};
+
+void clip_buffer_clean(struct clip_buffer *cb);
+unsigned int polygon_clip_box(const struct point_c *poly, unsigned int count,
+	float x0, float y0, float x1, float y1, struct clip_buffer *cb,
+	const struct point_c **clipped);
+
 struct star_params {
 	unsigned int points;
 	unsigned int density;
@@ -137,4 +170,63 @@ static inline void polygon_star_setup(const struct star_params *star_params,
 
 void node_buffer_clean(struct node_buffer *nb);
 
+/*
+ * polygon_simplify() and node_buffer_simplify() drop the nodes that lie
+ * within tolerance of the outline that is left, with no allocation.
+ * stats collects the nodes seen and removed over any number of calls, and
+ * the largest distance of a removed node from the new outline.
+ */
+
+struct simplify_stats {
+	unsigned int node_count;
+	unsigned int removed;
+	float max_deviation;
+};
+
+unsigned int polygon_simplify(struct point_c *nodes, unsigned int count,
+	float tolerance, struct simplify_stats *stats);
+void node_buffer_simplify(struct node_buffer *nb, float tolerance,
+	struct simplify_stats *stats);
+
+/*
+ * A star's shape depends only on points and density, radius and rotation
+ * are a scale and a rotation of it.  star_place() takes the unit star for
+ * (points, density) from a per thread cache and transforms its vertices,
+ * with no allocation.  nodes must hold 2 * unit_star_points_max entries.
+ * Returns the node count, 0 for stars over unit_star_points_max points,
+ * which need polygon_star_setup().
+ */
+
+enum {unit_star_points_max = 32};
+
+unsigned int star_place(const struct star_params *star_params,
+	struct point_c *nodes);
+
+/*
+ * Planar flattening.  polygon_flatten() takes count polygons in painter's
+ * order, polygon i being points offsets[i] to offsets[i + 1], filled with
+ * the nonzero rule.  It splits their visible parts into disjoint regions,
+ * each owned by the polygon drawn there last.  A region is one or more
+ * closed loops, its holes running opposite to its outer boundary.
+ *
+ * With keys, neighbouring parts whose owners have the same key are merged
+ * into one region, a union of same keyed polygons where they show.  The
+ * owner of a merged region is one of its polygons.
+ */
+
+struct flatten_result {
+	struct point_c *points;
+	unsigned int point_count;
+	unsigned int *loops;		// first point of each loop, plus end.
+	unsigned int loop_count;
+	unsigned int *regions;		// first loop of each region, plus end.
+	unsigned int *owners;		// a polygon of each region.
+	unsigned int region_count;
+};
+
+void polygon_flatten(const struct point_c *points,
+	const unsigned int *offsets, const unsigned int *keys,
+	unsigned int count, struct flatten_result *result);
+void flatten_result_clean(struct flatten_result *result);
+
 #endif /* _MD_GENERATOR_GEOMETRY_H */
@@ -33,18 +33,28 @@ bool log_get_verbose(void)
 	return verbose_state;
 }
 
+/*
+ * The stderr lock is held over the prefix and the message, so lines from
+ * different threads don't get interleaved.
+ */
+
+static void log_out(const char *prefix, const char *func, int line,
+	const char *fmt, va_list ap)
+{
+	flockfile(stderr);
+	fprintf(stderr, "%s%s:%d: ", prefix, func, line);
+	vfprintf(stderr, fmt, ap);
+	fflush(stderr);
+	funlockfile(stderr);
+}
+
 void  __attribute__((unused)) _error(const char *func, int line,
 	const char *fmt, ...)
 {
 	va_list ap;
 
-	fprintf(stderr, "ERROR: %s:%d: ", func, line);
-
 	va_start(ap, fmt);
-
-	vfprintf(stderr, fmt, ap);
-	fflush(stderr);
-
+	log_out("ERROR: ", func, line, fmt, ap);
 	va_end(ap);
 
 	if (exit_on_error) {
@@ -62,13 +72,8 @@ void  __attribute__((unused)) _log(const char *func, int line,
 		return;
 	}
 
-	fprintf(stderr, "%s:%d: ", func, line);
-
 	va_start(ap, fmt);
-
-	vfprintf(stderr, fmt, ap);
-	fflush(stderr);
-
+	log_out("", func, line, fmt, ap);
 	va_end(ap);
 }
 
@@ -77,12 +82,7 @@ void  __attribute__((unused)) _warn(const char *func, int line,
 {
 	va_list ap;
 
-	fprintf(stderr, "WARNING: %s:%d: ", func, line);
-
 	va_start(ap, fmt);
-
-	vfprintf(stderr, fmt, ap);
-	fflush(stderr);
-
+	log_out("WARNING: ", func, line, fmt, ap);
 	va_end(ap);
 }
@@ -11,32 +11,288 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <string.h>
 
 #include "log.h"
 #include "mem.h"
 
+#if !defined(MEM_FAST_ALLOC) || defined(DEBUG)
 static const unsigned int header_pattern = 0xaabbccddU;
 static const unsigned int footer_pattern = 0xccbbaa99U;
+#endif
 
+/*
+ * Two tiers, picked by configure.  The guarded tier checks each block's
+ * header and footer on every call.  The fast tier, MEM_FAST_ALLOC, keeps
+ * only the size and size class in front of a block, and recycles small
+ * blocks through per-thread free lists.
+ */
+
+#if defined(MEM_FAST_ALLOC)
+struct mem_header {
+	size_t size;
+	unsigned int site;	// census call site.
+	unsigned int size_class;
+};
+#else
 struct mem_footer {
 	unsigned int guard;
 };
 
 struct mem_header {
 	unsigned int guard1;
+	unsigned int site;	// census call site.
 	size_t size;
 	struct mem_footer *footer;
 	bool freed;
 	unsigned int guard2;
 };
+#endif
 
 static struct mem_header *to_header(void *p)
 {
 	return (struct mem_header *)p - 1;
 }
 
-void *mem_alloc(size_t size)
+/*
+ * Census.  The call sites are kept in an open addressed table, the last
+ * slot taking any that don't fit.  All of it is under one lock, taken only
+ * once the census has started.
+ */
+
+enum {
+	census_site_max = 1024U,
+	census_site_none = UINT_MAX,
+	census_report_sites = 16U,
+};
+
+struct census_site {
+	const char *func;
+	int line;
+	unsigned long allocs;
+	size_t bytes;
+	unsigned long live_blocks;
+	size_t live_bytes;
+};
+
+static struct census {
+	pthread_mutex_t lock;
+	bool on;
+	struct mem_stats stats;
+	struct census_site sites[census_site_max];
+} census = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static unsigned int census_size_class(size_t size)
+{
+	unsigned int bits = 0;
+
+	for (; size; size >>= 1) {
+		bits++;
+	}
+	return bits;
+}
+
+static unsigned int census_site(const char *func, int line)
+{
+	const unsigned int other = census_site_max - 1;
+	unsigned int i = (unsigned int)(((size_t)func >> 4) * 31U
+		+ (unsigned int)line) % other;
+	unsigned int tries;
+
+	for (tries = 0; tries < other; tries++, i = (i + 1) % other) {
+		struct census_site *site = &census.sites[i];
+
+		if (!site->func) {
+			site->func = func;
+			site->line = line;
+			return i;
+		}
+		if (site->func == func && site->line == line) {
+			return i;
+		}
+	}
+	census.sites[other].func = "(other)";
+	return other;
+}
+
+static void census_add(struct mem_header *header, const char *func,
+	int line, bool realloc)
+{
+	struct mem_stats *stats = &census.stats;
+	struct census_site *site;
+
+	header->site = census_site_none;
+
+	if (!census.on) {
+		return;
+	}
+
+	pthread_mutex_lock(&census.lock);
+
+	header->site = census_site(func, line);
+	site = &census.sites[header->site];
+
+	site->allocs++;
+	site->bytes += header->size;
+	site->live_blocks++;
+	site->live_bytes += header->size;
+
+	if (realloc) {
+		stats->reallocs++;
+	} else {
+		stats->allocs++;
+	}
+	stats->size_classes[census_size_class(header->size)]++;
+
+	stats->live_blocks++;
+	stats->live_bytes += header->size;
+
+	if (stats->live_bytes > stats->peak_bytes) {
+		stats->peak_bytes = stats->live_bytes;
+	}
+	if (stats->live_blocks > stats->peak_blocks) {
+		stats->peak_blocks = stats->live_blocks;
+	}
+
+	pthread_mutex_unlock(&census.lock);
+}
+
+static void census_remove(const struct mem_header *header, bool realloc)
+{
+	struct census_site *site;
+
+	if (header->site == census_site_none) {
+		return;
+	}
+
+	pthread_mutex_lock(&census.lock);
+
+	site = &census.sites[header->site];
+	site->live_blocks--;
+	site->live_bytes -= header->size;
+
+	census.stats.live_blocks--;
+	census.stats.live_bytes -= header->size;
+
+	if (!realloc) {
+		census.stats.frees++;
+	}
+
+	pthread_mutex_unlock(&census.lock);
+}
+
+static void census_exit(void)
+{
+	mem_census_report(stderr);
+}
+
+void mem_census_start(void)
+{
+	if (census.on) {
+		return;
+	}
+	census.on = true;
+	atexit(census_exit);
+}
+
+void mem_census_get(struct mem_stats *stats)
+{
+	pthread_mutex_lock(&census.lock);
+	*stats = census.stats;
+	pthread_mutex_unlock(&census.lock);
+}
+
+static int census_by_allocs(const void *a, const void *b)
+{
+	const struct census_site *sa = a;
+	const struct census_site *sb = b;
+
+	if (sa->allocs != sb->allocs) {
+		return (sa->allocs < sb->allocs) ? 1 : -1;
+	}
+	return (sa->bytes < sb->bytes) ? 1 : (sa->bytes > sb->bytes) ? -1 : 0;
+}
+
+static int census_by_live(const void *a, const void *b)
+{
+	const struct census_site *sa = a;
+	const struct census_site *sb = b;
+
+	if (sa->live_bytes != sb->live_bytes) {
+		return (sa->live_bytes < sb->live_bytes) ? 1 : -1;
+	}
+	return (sa->live_blocks < sb->live_blocks) ? 1
+		: (sa->live_blocks > sb->live_blocks) ? -1 : 0;
+}
+
+/*
+ * mem_census_report - Sorts a copy of the site table, so it takes no
+ * memory of its own to count.
+ */
+
+void mem_census_report(FILE *fp)
+{
+	static struct census_site sites[census_site_max];
+	struct mem_stats stats;
+	unsigned int count;
+	unsigned int i;
+
+	pthread_mutex_lock(&census.lock);
+	stats = census.stats;
+	for (i = 0, count = 0; i < census_site_max; i++) {
+		if (census.sites[i].func) {
+			sites[count++] = census.sites[i];
+		}
+	}
+	pthread_mutex_unlock(&census.lock);
+
+	fprintf(fp, "Memory census:\n"
+		"  calls:  %lu alloc, %lu realloc, %lu free\n"
+		"  live:   %lu blocks, %lu bytes\n"
+		"  peak:   %lu blocks, %lu bytes\n"
+		"  sizes:\n",
+		stats.allocs, stats.reallocs, stats.frees,
+		stats.live_blocks, (unsigned long)stats.live_bytes,
+		stats.peak_blocks, (unsigned long)stats.peak_bytes);
+
+	for (i = 0; i < mem_size_classes; i++) {
+		if (stats.size_classes[i]) {
+			fprintf(fp, "    < 2^%-2u  %lu\n", i,
+				stats.size_classes[i]);
+		}
+	}
+
+	qsort(sites, count, sizeof(sites[0]), census_by_allocs);
+
+	fprintf(fp, "  sites by calls:\n");
+	for (i = 0; i < count && i < census_report_sites; i++) {
+		fprintf(fp, "    %s:%d: %lu calls, %lu bytes\n",
+			sites[i].func, sites[i].line, sites[i].allocs,
+			(unsigned long)sites[i].bytes);
+	}
+
+	if (!stats.live_blocks) {
+		return;
+	}
+
+	qsort(sites, count, sizeof(sites[0]), census_by_live);
+
+	fprintf(fp, "  leaks:\n");
+	for (i = 0; i < count && sites[i].live_blocks; i++) {
+		fprintf(fp, "    %s:%d: %lu blocks, %lu bytes\n",
+			sites[i].func, sites[i].line, sites[i].live_blocks,
+			(unsigned long)sites[i].live_bytes);
+	}
+}
+
+#if !defined(MEM_FAST_ALLOC)
+static const unsigned char uninit_poison = 0xcd;
+
+static void *guard_alloc(size_t size, const char *func, int line)
 {
 	struct mem_header *header;
 	struct mem_footer *footer;
@@ -56,8 +312,6 @@ void *mem_alloc(size_t size)
 
 	//debug("sizeof = %lu, header = %p, p = %p\n",
 	//	sizeof(struct mem_header), header, p);
-	
-	memset(p, 0, size);
 
 	footer = p + size;
 	footer->guard = footer_pattern;
@@ -68,23 +322,89 @@ void *mem_alloc(size_t size)
 	header->freed = false;
 	header->guard2 = header_pattern;
 
+	census_add(header, func, line, false);
+
 	return p;
 }
 
-void *mem_realloc(void *p, size_t size)
+void *_mem_alloc(size_t size, const char *func, int line)
+{
+	return memset(guard_alloc(size, func, line), 0, size);
+}
+
+// Poisoned, so code that counts on zeroed memory shows up.
+void *_mem_alloc_uninit(size_t size, const char *func, int line)
+{
+	return memset(guard_alloc(size, func, line), uninit_poison, size);
+}
+
+static void check_header(const struct mem_header *header)
 {
-	void *n = realloc(p, size);
+	if (header->guard1 != header_pattern ||
+		header->guard2 != header_pattern) {
+		error("Bad header guard.\n");
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	if (header->freed == true) {
+		error("Double free.\n");
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
 
-	error("TODO: Need to add header.\n");
-	assert(0);
-	exit(EXIT_FAILURE);
+	if (header->footer->guard != footer_pattern) {
+		error("Bad footer guard, buffer over run.\n");
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+}
 
-	if (!n) {
+/*
+ * mem_realloc - Like mem_alloc() for NULL p.  Any growth is zeroed, as
+ * mem_alloc() memory is.
+ */
+
+void *_mem_realloc(void *p, size_t size, const char *func, int line)
+{
+	struct mem_header *header;
+	struct mem_footer *footer;
+	size_t old_size;
+	void *n;
+
+	if (!p) {
+		return _mem_alloc(size, func, line);
+	}
+
+	header = to_header(p);
+	check_header(header);
+	old_size = header->size;
+	census_remove(header, true);
+
+	header = realloc(header, sizeof(struct mem_header) + size +
+		sizeof(struct mem_footer));
+
+	if (!header) {
 		error("Realloc %lu failed: %s.\n", (unsigned long)size,
 			strerror(errno));
 		assert(0);
 		exit(EXIT_FAILURE);
 	}
+
+	n = header + 1;
+
+	if (size > old_size) {
+		memset(n + old_size, 0, size - old_size);
+	}
+
+	footer = n + size;
+	footer->guard = footer_pattern;
+
+	header->size = size;
+	header->footer = footer;
+
+	census_add(header, func, line, true);
+
 	return n;
 }
 
@@ -99,27 +419,402 @@ void mem_free(void *p)
 	}
 
 	header = to_header(p);
+	check_header(header);
+	census_remove(header, false);
 
-	if (header->guard1 != header_pattern ||
-		header->guard2 != header_pattern) {
-		error("Bad header guard.\n");
-		assert(0);
-		exit(EXIT_FAILURE);
+	header->freed = true;
+
+	free(header);
+}
+#else
+
+/*
+ * Fast tier.  Blocks of up to fast_class_max bytes are rounded up to a
+ * power of two size class.  A freed one goes on its class list of the
+ * freeing thread, up to fast_cache_max of them, for the next allocation of
+ * that class on the thread to take.  A thread's lists are emptied when it
+ * exits.  Bigger blocks go straight to malloc.
+ */
+
+enum {
+	fast_class_shift = 4U,
+	fast_class_count = 8U,
+	fast_class_max = 1U << (fast_class_shift + fast_class_count - 1),
+	fast_class_large = UINT_MAX,
+	fast_cache_max = 256U,
+};
+
+struct fast_block {
+	struct fast_block *next;
+};
+
+struct fast_cache {
+	struct fast_block *blocks[fast_class_count];
+	unsigned int counts[fast_class_count];
+	bool registered;
+};
+
+static __thread struct fast_cache fast_cache;
+static pthread_key_t fast_key;
+static pthread_once_t fast_once = PTHREAD_ONCE_INIT;
+
+static unsigned int fast_class(size_t size)
+{
+	unsigned int c = 0;
+
+	if (size > fast_class_max) {
+		return fast_class_large;
 	}
+	while ((size_t)1 << (fast_class_shift + c) < size) {
+		c++;
+	}
+	return c;
+}
 
-	if (header->freed == true) {
-		error("Double free.\n");
+static size_t fast_class_size(unsigned int c)
+{
+	return (size_t)1 << (fast_class_shift + c);
+}
+
+static void fast_cache_drain(void *arg)
+{
+	struct fast_cache *cache = arg;
+	unsigned int c;
+
+	for (c = 0; c < fast_class_count; c++) {
+		while (cache->blocks[c]) {
+			struct fast_block *block = cache->blocks[c];
+
+			cache->blocks[c] = block->next;
+			free((struct mem_header *)block - 1);
+		}
+		cache->counts[c] = 0;
+	}
+	cache->registered = false;
+}
+
+static void fast_key_init(void)
+{
+	if (pthread_key_create(&fast_key, fast_cache_drain)) {
+		error("pthread_key_create failed.\n");
 		assert(0);
 		exit(EXIT_FAILURE);
 	}
+}
 
-	if (header->footer->guard != footer_pattern) {
-		error("Bad footer guard, buffer over run.\n");
+/* fast_get - A block for size bytes, its header set but not counted. */
+
+static struct mem_header *fast_get(size_t size)
+{
+	const unsigned int c = fast_class(size);
+	struct mem_header *header;
+
+	if (c != fast_class_large && fast_cache.blocks[c]) {
+		struct fast_block *block = fast_cache.blocks[c];
+
+		fast_cache.blocks[c] = block->next;
+		fast_cache.counts[c]--;
+		header = (struct mem_header *)block - 1;
+	} else {
+		header = malloc(sizeof(*header)
+			+ (c == fast_class_large ? size : fast_class_size(c)));
+
+		if (!header) {
+			error("Malloc %lu failed: %s.\n", (unsigned long)size,
+				strerror(errno));
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	header->size = size;
+	header->size_class = c;
+	return header;
+}
+
+static void fast_put(struct mem_header *header)
+{
+	const unsigned int c = header->size_class;
+	struct fast_block *block = (struct fast_block *)(header + 1);
+
+	if (c == fast_class_large || fast_cache.counts[c] >= fast_cache_max) {
+		free(header);
+		return;
+	}
+
+	if (!fast_cache.registered) {
+		pthread_once(&fast_once, fast_key_init);
+		pthread_setspecific(fast_key, &fast_cache);
+		fast_cache.registered = true;
+	}
+
+	block->next = fast_cache.blocks[c];
+	fast_cache.blocks[c] = block;
+	fast_cache.counts[c]++;
+}
+
+void *_mem_alloc_uninit(size_t size, const char *func, int line)
+{
+	struct mem_header *header = fast_get(size);
+
+	census_add(header, func, line, false);
+	return header + 1;
+}
+
+void *_mem_alloc(size_t size, const char *func, int line)
+{
+	return memset(_mem_alloc_uninit(size, func, line), 0, size);
+}
+
+/*
+ * mem_realloc - Like mem_alloc() for NULL p.  Any growth is zeroed, as
+ * mem_alloc() memory is.  A small block that still fits its class stays.
+ */
+
+void *_mem_realloc(void *p, size_t size, const char *func, int line)
+{
+	struct mem_header *header;
+	struct mem_header *n;
+	size_t old_size;
+
+	if (!p) {
+		return _mem_alloc(size, func, line);
+	}
+
+	header = to_header(p);
+	old_size = header->size;
+	census_remove(header, true);
+
+	if (header->size_class != fast_class_large
+		&& size <= fast_class_size(header->size_class)) {
+		n = header;
+	} else if (header->size_class == fast_class_large
+		&& size > fast_class_max) {
+		n = realloc(header, sizeof(*n) + size);
+
+		if (!n) {
+			error("Realloc %lu failed: %s.\n",
+				(unsigned long)size, strerror(errno));
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		n = fast_get(size);
+		memcpy(n + 1, p, old_size < size ? old_size : size);
+		fast_put(header);
+	}
+
+	if (size > old_size) {
+		memset((char *)(n + 1) + old_size, 0, size - old_size);
+	}
+
+	n->size = size;
+	census_add(n, func, line, true);
+
+	return n + 1;
+}
+
+void mem_free(void *p)
+{
+	struct mem_header *header;
+
+	if (!p) {
+		error("Null free.\n");
 		assert(0);
 		exit(EXIT_FAILURE);
 	}
 
-	header->freed = true;
+	header = to_header(p);
+	census_remove(header, false);
+	fast_put(header);
+}
+#endif
 
-	free(header);
+/*
+ * Arena chunks are kept in a list in the order they were first used, so
+ * after a reset they fill up again in the same order.  Each allocation is
+ * rounded up to arena_align.
+ */
+
+enum {arena_align = 16};
+
+struct mem_arena_chunk {
+	struct mem_arena_chunk *next;
+	size_t size;		// bytes of data.
+	size_t used;
+};
+
+static size_t arena_round(size_t size)
+{
+	return (size + arena_align - 1) & ~(size_t)(arena_align - 1);
+}
+
+static char *arena_data(struct mem_arena_chunk *chunk)
+{
+	return (char *)chunk + arena_round(sizeof(*chunk));
+}
+
+#if defined(DEBUG)
+static const unsigned char arena_poison = 0xdb;
+
+struct arena_guard {
+	unsigned int guard;
+	size_t size;
+};
+
+static const size_t arena_head = (sizeof(struct arena_guard) + arena_align
+	- 1) & ~(size_t)(arena_align - 1);
+
+static size_t arena_need(size_t size)
+{
+	return arena_head + arena_round(size + sizeof(unsigned int));
+}
+
+static void *arena_guard_set(char *block, size_t size)
+{
+	struct arena_guard *head = (struct arena_guard *)block;
+	const unsigned int footer = footer_pattern;
+
+	head->guard = header_pattern;
+	head->size = size;
+	memcpy(block + arena_head + size, &footer, sizeof(footer));
+	return block + arena_head;
+}
+
+static void arena_guard_check(struct mem_arena_chunk *chunk)
+{
+	char *block = arena_data(chunk);
+	char *end = block + chunk->used;
+
+	while (block < end) {
+		const struct arena_guard *head =
+			(const struct arena_guard *)block;
+		unsigned int footer;
+
+		if (head->guard != header_pattern) {
+			error("Bad arena header guard.\n");
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+
+		memcpy(&footer, block + arena_head + head->size,
+			sizeof(footer));
+
+		if (footer != footer_pattern) {
+			error("Bad arena footer guard, buffer over run.\n");
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+		block += arena_need(head->size);
+	}
+	memset(arena_data(chunk), arena_poison, chunk->used);
+}
+#else
+static size_t arena_need(size_t size)
+{
+	return arena_round(size);
+}
+
+static void *arena_guard_set(char *block, size_t size)
+{
+	(void)size;
+	return block;
+}
+#endif
+
+void mem_arena_init(struct mem_arena *arena, size_t chunk_size)
+{
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->chunk_size = chunk_size ? chunk_size : mem_arena_chunk_default;
+}
+
+/*
+ * arena_next - Move on to a chunk after the current one with room for
+ * need bytes, adding one if the next chunk is too small.
+ */
+
+static void arena_next(struct mem_arena *arena, size_t need)
+{
+	struct mem_arena_chunk *next = arena->current
+		? arena->current->next : arena->first;
+	const size_t size = need > arena->chunk_size ? need : arena->chunk_size;
+	struct mem_arena_chunk *chunk;
+
+	if (next && next->size >= need) {
+		next->used = 0;
+		arena->current = next;
+		return;
+	}
+
+	// Chunks are mem_alloc() blocks so the census sees them.
+	chunk = mem_alloc_uninit(arena_round(sizeof(*chunk)) + size);
+
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = next;
+
+	if (arena->current) {
+		arena->current->next = chunk;
+	} else {
+		arena->first = chunk;
+	}
+	arena->current = chunk;
+}
+
+void *mem_arena_alloc(struct mem_arena *arena, size_t size)
+{
+	const size_t need = arena_need(size);
+	struct mem_arena_chunk *chunk = arena->current;
+	char *block;
+
+	if (!chunk || chunk->size - chunk->used < need) {
+		arena_next(arena, need);
+		chunk = arena->current;
+	}
+
+	block = arena_data(chunk) + chunk->used;
+	chunk->used += need;
+
+	memset(block, 0, need);
+	return arena_guard_set(block, size);
+}
+
+/*
+ * mem_arena_reset - Only the chunks up to the current one were used since
+ * the last reset.  Without DEBUG only the first is touched, the others are
+ * emptied as the arena moves on to them.
+ */
+
+void mem_arena_reset(struct mem_arena *arena)
+{
+	struct mem_arena_chunk *chunk;
+
+	if (!arena->current) {
+		return;
+	}
+
+#if defined(DEBUG)
+	for (chunk = arena->first; chunk != arena->current->next;
+		chunk = chunk->next) {
+		arena_guard_check(chunk);
+	}
+#endif
+
+	chunk = arena->first;
+	chunk->used = 0;
+	arena->current = chunk;
+}
+
+void mem_arena_clean(struct mem_arena *arena)
+{
+	mem_arena_reset(arena);
+
+	while (arena->first) {
+		struct mem_arena_chunk *next = arena->first->next;
+
+		mem_free(arena->first);
+		arena->first = next;
+	}
+	arena->current = NULL;
 }
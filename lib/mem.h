@@ -5,10 +5,70 @@
 #if ! defined(_MD_GENERATOR_MEM_H)
 #define _MD_GENERATOR_MEM_H
 
+#include <stdio.h>
 #include <stdlib.h>
 
-void *mem_alloc(size_t size);
-void *mem_realloc(void *p, size_t size);
+/*
+ * mem_alloc() memory is zeroed.  mem_alloc_uninit() memory is not, for
+ * callers that write all of it anyway; the guarded allocator fills it with
+ * a poison pattern.
+ */
+
+void *_mem_alloc(size_t size, const char *func, int line);
+void *_mem_alloc_uninit(size_t size, const char *func, int line);
+void *_mem_realloc(void *p, size_t size, const char *func, int line);
 void mem_free(void *p);
 
+#define mem_alloc(_size) _mem_alloc(_size, __func__, __LINE__)
+#define mem_alloc_uninit(_size) _mem_alloc_uninit(_size, __func__, __LINE__)
+#define mem_realloc(_p, _size) _mem_realloc(_p, _size, __func__, __LINE__)
+
+/*
+ * The memory census counts the mem_alloc() blocks made after
+ * mem_census_start(): live and peak bytes, calls, a histogram of power of
+ * two size classes, and allocations by call site.  The report, printed at
+ * exit, ends with the call sites of any blocks still live.  Blocks made
+ * before the start are not counted.
+ */
+
+enum {mem_size_classes = 8 * sizeof(size_t) + 1};
+
+struct mem_stats {
+	size_t live_bytes;
+	size_t peak_bytes;
+	unsigned long live_blocks;
+	unsigned long peak_blocks;
+	unsigned long allocs;
+	unsigned long reallocs;
+	unsigned long frees;
+	unsigned long size_classes[mem_size_classes];	// by bit length.
+};
+
+void mem_census_start(void);
+void mem_census_get(struct mem_stats *stats);
+void mem_census_report(FILE *fp);
+
+/*
+ * A mem_arena hands out zeroed memory from large chunks by bumping a
+ * pointer.  Nothing is freed alone: mem_arena_reset() makes all of it free
+ * again in O(1) and keeps the chunks for reuse, mem_arena_clean() frees the
+ * chunks.  An arena is not thread safe, give each thread its own.  DEBUG
+ * builds guard each allocation and check the guards on reset and clean.
+ */
+
+struct mem_arena_chunk;
+
+struct mem_arena {
+	struct mem_arena_chunk *first;
+	struct mem_arena_chunk *current;
+	size_t chunk_size;
+};
+
+enum {mem_arena_chunk_default = 64 * 1024};
+
+void mem_arena_init(struct mem_arena *arena, size_t chunk_size);
+void *mem_arena_alloc(struct mem_arena *arena, size_t size);
+void mem_arena_reset(struct mem_arena *arena);
+void mem_arena_clean(struct mem_arena *arena);
+
 #endif /* _MD_GENERATOR_MEM_H */
@@ -0,0 +1,390 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mem.h"
+#include "random.h"
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void random_gen_seed(struct random_gen *gen, uint64_t seed)
+{
+	unsigned int i;
+
+	// splitmix64 never gives four zero words, the one bad xoshiro state.
+	for (i = 0; i < 4; i++) {
+		gen->s[i] = splitmix64(&seed);
+	}
+}
+
+void random_gen_jump(struct random_gen *gen)
+{
+	static const uint64_t jump[] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL,
+	};
+	uint64_t s[4] = {0, 0, 0, 0};
+	unsigned int i;
+	unsigned int b;
+
+	for (i = 0; i < sizeof(jump) / sizeof(jump[0]); i++) {
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & (1ULL << b)) {
+				s[0] ^= gen->s[0];
+				s[1] ^= gen->s[1];
+				s[2] ^= gen->s[2];
+				s[3] ^= gen->s[3];
+			}
+			random_gen_next(gen);
+		}
+	}
+
+	gen->s[0] = s[0];
+	gen->s[1] = s[1];
+	gen->s[2] = s[2];
+	gen->s[3] = s[3];
+}
+
+/*
+ * random_bounded - Uniform in [min, max] from the draws of next, without
+ * the modulo bias of next % range.  Lemire's multiply and shift, rejecting
+ * the few low products that would over-represent some values.
+ */
+
+static unsigned int random_bounded(uint64_t (*next)(void *), void *state,
+	unsigned int min, unsigned int max)
+{
+	const uint32_t range = max - min + 1;
+	uint64_t m;
+
+	assert(min <= max);
+
+	if (!range) {
+		return (unsigned int)(next(state) >> 32);
+	}
+
+	m = (next(state) >> 32) * range;
+
+	if ((uint32_t)m < range) {
+		const uint32_t limit = -range % range;
+
+		while ((uint32_t)m < limit) {
+			m = (next(state) >> 32) * range;
+		}
+	}
+
+	return min + (unsigned int)(m >> 32);
+}
+
+static int random_bounded_int(uint64_t (*next)(void *), void *state,
+	int min, int max)
+{
+	assert(min <= max);
+
+	return (int)((unsigned int)min + random_bounded(next, state, 0,
+		(unsigned int)max - (unsigned int)min));
+}
+
+static uint64_t gen_next(void *state)
+{
+	return random_gen_next(state);
+}
+
+unsigned int random_gen_unsigned(struct random_gen *gen, unsigned int min,
+	unsigned int max)
+{
+	return random_bounded(gen_next, gen, min, max);
+}
+
+int random_gen_int(struct random_gen *gen, int min, int max)
+{
+	return random_bounded_int(gen_next, gen, min, max);
+}
+
+void random_gen_fill_float(struct random_gen *gen, float *out,
+	unsigned int count, float min, float max)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		out[i] = random_gen_float(gen, min, max);
+	}
+}
+
+/* random_shuffle - Fisher-Yates shuffle. */
+
+static void random_shuffle(uint64_t (*next)(void *), void *state,
+	unsigned int *array, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = len; i > 1; i--) {
+		const unsigned int j = random_bounded(next, state, 0, i - 1);
+		const unsigned int tmp = array[i - 1];
+
+		array[i - 1] = array[j];
+		array[j] = tmp;
+	}
+}
+
+void random_gen_shuffle(struct random_gen *gen, unsigned int *array,
+	unsigned int len)
+{
+	random_shuffle(gen_next, gen, array, len);
+}
+
+/*
+ * Philox4x32-10, from Salmon et al., "Parallel Random Numbers: As Easy as
+ * 1, 2, 3".  Each block of four output words is ten rounds over the
+ * counter.
+ */
+
+static const uint32_t philox_m0 = 0xd2511f53U;
+static const uint32_t philox_m1 = 0xcd9e8d57U;
+static const uint32_t philox_w0 = 0x9e3779b9U;
+static const uint32_t philox_w1 = 0xbb67ae85U;
+
+static void philox_block(const uint32_t key[2], const uint32_t ctr[4],
+	uint32_t out[4])
+{
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+	uint32_t c[4];
+	unsigned int round;
+
+	memcpy(c, ctr, sizeof(c));
+
+	for (round = 0; round < 10; round++) {
+		const uint64_t p0 = (uint64_t)philox_m0 * c[0];
+		const uint64_t p1 = (uint64_t)philox_m1 * c[2];
+
+		c[0] = (uint32_t)(p1 >> 32) ^ c[1] ^ k0;
+		c[1] = (uint32_t)p1;
+		c[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+		c[3] = (uint32_t)p0;
+
+		k0 += philox_w0;
+		k1 += philox_w1;
+	}
+
+	memcpy(out, c, sizeof(c));
+}
+
+void random_ctr_init(struct random_ctr *rc, uint64_t seed, uint32_t a,
+	uint32_t b)
+{
+	rc->key[0] = (uint32_t)seed;
+	rc->key[1] = (uint32_t)(seed >> 32);
+	rc->ctr[0] = 0;
+	rc->ctr[1] = 0;
+	rc->ctr[2] = a;
+	rc->ctr[3] = b;
+	rc->used = 4;
+}
+
+uint64_t random_ctr_next(struct random_ctr *rc)
+{
+	uint64_t result;
+
+	if (rc->used == 4) {
+		philox_block(rc->key, rc->ctr, rc->out);
+		if (!++rc->ctr[0]) {
+			rc->ctr[1]++;
+		}
+		rc->used = 0;
+	}
+
+	result = ((uint64_t)rc->out[rc->used] << 32) | rc->out[rc->used + 1];
+	rc->used += 2;
+	return result;
+}
+
+static uint64_t ctr_next(void *state)
+{
+	return random_ctr_next(state);
+}
+
+unsigned int random_ctr_unsigned(struct random_ctr *rc, unsigned int min,
+	unsigned int max)
+{
+	return random_bounded(ctr_next, rc, min, max);
+}
+
+int random_ctr_int(struct random_ctr *rc, int min, int max)
+{
+	return random_bounded_int(ctr_next, rc, min, max);
+}
+
+/*
+ * Random permutation.  A balanced Feistel network on 2 * half_bits bits is
+ * a bijection of [0, 4^half_bits), the smallest such range holding n, so
+ * under 4n.  Cycle walking re-applies it until the value falls in [0, n),
+ * which keeps it a bijection of [0, n) and takes under 4 steps on average.
+ */
+
+void random_perm_init(struct random_perm *perm, unsigned int n,
+	uint64_t seed)
+{
+	unsigned int r;
+
+	perm->n = n;
+	perm->half_bits = 1;
+	while (perm->half_bits < 16 && (1ULL << (2 * perm->half_bits)) < n) {
+		perm->half_bits++;
+	}
+	perm->half_mask = (1U << perm->half_bits) - 1;
+
+	for (r = 0; r < random_perm_rounds; r++) {
+		perm->keys[r] = (uint32_t)splitmix64(&seed);
+	}
+}
+
+static uint32_t perm_round(uint32_t x, uint32_t key)
+{
+	x ^= key;
+	x *= 0x85ebca6bU;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35U;
+	x ^= x >> 16;
+	return x;
+}
+
+static uint32_t perm_feistel(const struct random_perm *perm, uint32_t x)
+{
+	uint32_t left = x >> perm->half_bits;
+	uint32_t right = x & perm->half_mask;
+	unsigned int r;
+
+	for (r = 0; r < random_perm_rounds; r++) {
+		const uint32_t next = left ^ (perm_round(right, perm->keys[r])
+			& perm->half_mask);
+
+		left = right;
+		right = next;
+	}
+
+	return (left << perm->half_bits) | right;
+}
+
+/* random_perm_get - Element i of the permutation, for i < n. */
+
+unsigned int random_perm_get(const struct random_perm *perm, unsigned int i)
+{
+	uint32_t x = i;
+
+	assert(i < perm->n);
+
+	do {
+		x = perm_feistel(perm, x);
+	} while (x >= perm->n);
+
+	return x;
+}
+
+/*
+ * Each thread has its own generator state, so threads never contend and a
+ * thread's sequence depends only on what it was seeded with.  The initial
+ * state is random_gen_seed() of 0.
+ */
+
+struct thread_random {
+	struct random_gen gen;
+	struct random_ctr ctr;
+	bool use_ctr;
+};
+
+static __thread struct thread_random thread_random = {
+	.gen = {{
+		0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL,
+		0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL,
+	}},
+};
+
+static uint64_t thread_next(void *state)
+{
+	struct thread_random *tr = state;
+
+	return tr->use_ctr ? random_ctr_next(&tr->ctr)
+		: random_gen_next(&tr->gen);
+}
+
+void random_seed(unsigned int seed)
+{
+	random_gen_seed(&thread_random.gen, seed);
+	thread_random.use_ctr = false;
+}
+
+/*
+ * random_seed_cell - Switch this thread to the counter based stream keyed
+ * by (seed, row, column), until the next random_seed().  The draws for a
+ * grid cell then don't depend on which other cells were generated, in what
+ * order or on which thread.
+ */
+
+void random_seed_cell(unsigned int seed, unsigned int row,
+	unsigned int column)
+{
+	random_ctr_init(&thread_random.ctr, seed, row, column);
+	thread_random.use_ctr = true;
+}
+
+int random_int(int min, int max)
+{
+	return random_bounded_int(thread_next, &thread_random, min, max);
+}
+
+unsigned int random_unsigned(unsigned int min, unsigned int max)
+{
+	return random_bounded(thread_next, &thread_random, min, max);
+}
+
+float random_float(float min, float max)
+{
+	return random_to_float(thread_next(&thread_random), min, max);
+}
+
+void random_fill_float(float *out, unsigned int count, float min, float max)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		out[i] = random_float(min, max);
+	}
+}
+
+/* random_array - A random permutation of [0, len). */
+
+unsigned int *random_array(unsigned int len)
+{
+	unsigned int *p;
+	unsigned int i;
+
+	p = mem_alloc(len * sizeof(*p));
+
+	for (i = 0; i < len; i++) {
+		p[i] = i;
+	}
+
+	random_shuffle(thread_next, &thread_random, p, len);
+
+	return p;
+}
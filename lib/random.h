@@ -0,0 +1,121 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#if ! defined(_MD_GENERATOR_RANDOM_H)
+#define _MD_GENERATOR_RANDOM_H
+
+#include <stdint.h>
+
+/*
+ * Pseudo random numbers from xoshiro256**.  A random_gen holds one
+ * generator state, seeded from a 64 bit value with splitmix64.
+ * random_gen_jump() advances a state by 2^128 draws, so streams made by
+ * seeding once and jumping never overlap.
+ *
+ * A random_ctr is counter based (Philox4x32-10): draw n of the stream
+ * keyed by (seed, a, b) is a hash of those values and n, so any stream can
+ * be started in O(1) without replaying others.
+ *
+ * A random_perm is a keyed random permutation of [0, n) that takes O(1)
+ * memory and gives element i in O(1) expected time.
+ *
+ * The random_* calls without a state use a per thread generator, set up
+ * with random_seed() or, in counter mode, random_seed_cell().
+ */
+
+struct random_gen {
+	uint64_t s[4];
+};
+
+void random_gen_seed(struct random_gen *gen, uint64_t seed);
+void random_gen_jump(struct random_gen *gen);
+
+static inline uint64_t random_gen_rotl(uint64_t x, unsigned int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t random_gen_next(struct random_gen *gen)
+{
+	uint64_t *s = gen->s;
+	const uint64_t result = random_gen_rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = random_gen_rotl(s[3], 45);
+
+	return result;
+}
+
+unsigned int random_gen_unsigned(struct random_gen *gen, unsigned int min,
+	unsigned int max);
+int random_gen_int(struct random_gen *gen, int min, int max);
+
+/* random_to_float - Draw mapped to a uniform float in [min, max). */
+
+static inline float random_to_float(uint64_t draw, float min, float max)
+{
+	const float u = (float)(draw >> 40) * 0x1.0p-24f;
+
+	return min + u * (max - min);
+}
+
+static inline float random_gen_float(struct random_gen *gen, float min,
+	float max)
+{
+	return random_to_float(random_gen_next(gen), min, max);
+}
+
+void random_gen_fill_float(struct random_gen *gen, float *out,
+	unsigned int count, float min, float max);
+void random_gen_shuffle(struct random_gen *gen, unsigned int *array,
+	unsigned int len);
+
+struct random_ctr {
+	uint32_t key[2];
+	uint32_t ctr[4];	// block number, a, b.
+	uint32_t out[4];
+	unsigned int used;	// out words consumed.
+};
+
+void random_ctr_init(struct random_ctr *rc, uint64_t seed, uint32_t a,
+	uint32_t b);
+uint64_t random_ctr_next(struct random_ctr *rc);
+unsigned int random_ctr_unsigned(struct random_ctr *rc, unsigned int min,
+	unsigned int max);
+int random_ctr_int(struct random_ctr *rc, int min, int max);
+
+static inline float random_ctr_float(struct random_ctr *rc, float min,
+	float max)
+{
+	return random_to_float(random_ctr_next(rc), min, max);
+}
+
+enum {random_perm_rounds = 4};
+
+struct random_perm {
+	unsigned int n;
+	unsigned int half_bits;
+	uint32_t half_mask;
+	uint32_t keys[random_perm_rounds];
+};
+
+void random_perm_init(struct random_perm *perm, unsigned int n,
+	uint64_t seed);
+unsigned int random_perm_get(const struct random_perm *perm, unsigned int i);
+
+void random_seed(unsigned int seed);
+void random_seed_cell(unsigned int seed, unsigned int row,
+	unsigned int column);
+int random_int(int min, int max);
+unsigned int random_unsigned(unsigned int min, unsigned int max);
+float random_float(float min, float max);
+void random_fill_float(float *out, unsigned int count, float min, float max);
+unsigned int *random_array(unsigned int len);
+
+#endif /* _MD_GENERATOR_RANDOM_H */
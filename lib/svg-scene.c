@@ -0,0 +1,1885 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "mem.h"
+#include "svg-scene.h"
+#include "util.h"
+#include "vector.h"
+
+void svg_scene_init(struct svg_scene *scene)
+{
+	memset(scene, 0, sizeof(*scene));
+	scene->group = svg_scene_none;
+}
+
+void svg_scene_clean(struct svg_scene *scene)
+{
+	assert(scene->group == svg_scene_none);
+
+	if (scene->x) {
+		mem_free(scene->x);
+		mem_free(scene->y);
+	}
+	if (scene->items) {
+		mem_free(scene->items);
+	}
+	if (scene->styles) {
+		mem_free(scene->styles);
+	}
+	if (scene->transforms) {
+		mem_free(scene->transforms);
+	}
+	if (scene->names) {
+		mem_free(scene->names);
+	}
+	if (scene->defs) {
+		mem_free(scene->defs);
+	}
+	if (scene->loops) {
+		mem_free(scene->loops);
+	}
+	memset(scene, 0, sizeof(*scene));
+	scene->group = svg_scene_none;
+}
+
+static bool style_equal(const struct svg_style *a, const struct svg_style *b)
+{
+	return !strcmp(a->fill.color, b->fill.color)
+		&& !strcmp(a->stroke.color, b->stroke.color)
+		&& a->stroke.width == b->stroke.width;
+}
+
+/*
+ * svg_scene_add_style - Index of style in the style table, added if not
+ * already there.  Scenes use a handful of styles, so a linear search is
+ * all that's needed.
+ */
+
+unsigned int svg_scene_add_style(struct svg_scene *scene,
+	const struct svg_style *style)
+{
+	unsigned int i;
+
+	if (!style) {
+		return svg_scene_none;
+	}
+
+	for (i = scene->style_count; i; i--) {
+		if (style_equal(&scene->styles[i - 1], style)) {
+			return i - 1;
+		}
+	}
+
+	scene->styles = vector_grow(scene->styles, &scene->style_size,
+		scene->style_count + 1, sizeof(*scene->styles));
+	scene->styles[scene->style_count] = *style;
+	scene->styles[scene->style_count].style_class = 0;
+	return scene->style_count++;
+}
+
+static unsigned int add_transform(struct svg_scene *scene,
+	const struct svg_transform *transform)
+{
+	if (!transform) {
+		return svg_scene_none;
+	}
+
+	scene->transforms = vector_grow(scene->transforms,
+		&scene->transform_size, scene->transform_count + 1,
+		sizeof(*scene->transforms));
+	scene->transforms[scene->transform_count] = *transform;
+	return scene->transform_count++;
+}
+
+static unsigned int add_name(struct svg_scene *scene, const char *name)
+{
+	const unsigned int len = name ? strlen(name) + 1 : 0;
+	unsigned int offset;
+
+	if (!name) {
+		return svg_scene_none;
+	}
+
+	scene->names = vector_grow(scene->names, &scene->names_size,
+		scene->names_len + len, 1);
+	offset = scene->names_len;
+	memcpy(scene->names + offset, name, len);
+	scene->names_len += len;
+	return offset;
+}
+
+static unsigned int add_points(struct svg_scene *scene, unsigned int count)
+{
+	const unsigned int offset = scene->point_count;
+	unsigned int size = scene->point_size;
+
+	scene->x = vector_grow(scene->x, &size, scene->point_count + count,
+		sizeof(*scene->x));
+	scene->y = vector_grow(scene->y, &scene->point_size,
+		scene->point_count + count, sizeof(*scene->y));
+	assert(size == scene->point_size);
+
+	scene->point_count += count;
+	if (count > scene->count_max) {
+		scene->count_max = count;
+	}
+	return offset;
+}
+
+static struct svg_scene_item *add_item(struct svg_scene *scene,
+	enum svg_scene_kind kind, unsigned int style,
+	const struct svg_transform *transform, const char *id,
+	unsigned int count)
+{
+	struct svg_scene_item *item;
+
+	assert(!scene->instanced);
+
+	scene->items = vector_grow(scene->items, &scene->item_size,
+		scene->item_count + 1, sizeof(*scene->items));
+
+	item = &scene->items[scene->item_count++];
+	item->kind = kind;
+	item->parent = scene->group;
+	item->id = add_name(scene, id);
+	item->href = svg_scene_none;
+	assert(style == svg_scene_none || style < scene->style_count);
+	item->style = style;
+	item->transform = add_transform(scene, transform);
+	item->offset = add_points(scene, count);
+	item->count = count;
+	item->origin.x = 0.0;
+	item->origin.y = 0.0;
+	item->instance = svg_scene_none;
+	item->loops = svg_scene_none;
+	item->culled = false;
+
+	return item;
+}
+
+static unsigned int item_index(const struct svg_scene *scene,
+	const struct svg_scene_item *item)
+{
+	return (unsigned int)(item - scene->items);
+}
+
+unsigned int svg_scene_open_group(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id)
+{
+	struct svg_scene_item *item;
+
+	item = add_item(scene, svg_scene_group,
+		svg_scene_add_style(scene, style), transform, id, 0);
+	scene->group = item_index(scene, item);
+	return scene->group;
+}
+
+void svg_scene_close_group(struct svg_scene *scene)
+{
+	const unsigned int group = scene->group;
+
+	assert(group != svg_scene_none);
+
+	add_item(scene, svg_scene_group_end, svg_scene_none, NULL, NULL, 0);
+	scene->group = scene->items[group].parent;
+}
+
+/*
+ * svg_scene_open_defs - Open a group written as <defs>, closed with
+ * svg_scene_close_group().
+ */
+
+unsigned int svg_scene_open_defs(struct svg_scene *scene)
+{
+	struct svg_scene_item *item;
+
+	item = add_item(scene, svg_scene_defs, svg_scene_none, NULL, NULL, 0);
+	scene->group = item_index(scene, item);
+	return scene->group;
+}
+
+static unsigned int add_nodes(struct svg_scene *scene,
+	enum svg_scene_kind kind, unsigned int style,
+	const struct svg_transform *transform, const char *id,
+	const struct point_c *origin, const struct point_c *nodes,
+	unsigned int count)
+{
+	struct svg_scene_item *item;
+	unsigned int i;
+
+	assert(id);
+	assert(count);
+
+	item = add_item(scene, kind, style, transform, id, count);
+
+	if (origin) {
+		item->origin = *origin;
+	}
+	for (i = 0; i < count; i++) {
+		scene->x[item->offset + i] = nodes[i].x;
+		scene->y[item->offset + i] = nodes[i].y;
+	}
+	return item_index(scene, item);
+}
+
+unsigned int svg_scene_add_path(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count)
+{
+	return add_nodes(scene, svg_scene_path,
+		svg_scene_add_style(scene, style), transform, id, origin,
+		nodes, count);
+}
+
+/*
+ * svg_scene_add_styled_path - svg_scene_add_path() with a style index from
+ * svg_scene_add_style(), for callers that add many paths with a few styles.
+ */
+
+unsigned int svg_scene_add_styled_path(struct svg_scene *scene,
+	unsigned int style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count)
+{
+	return add_nodes(scene, svg_scene_path, style, transform, id, origin,
+		nodes, count);
+}
+
+unsigned int svg_scene_add_polygon(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count)
+{
+	return add_nodes(scene, svg_scene_polygon,
+		svg_scene_add_style(scene, style), transform, id, origin,
+		nodes, count);
+}
+
+unsigned int svg_scene_add_rect(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct svg_rect *rect)
+{
+	const struct point_c nodes[] = {
+		{rect->x, rect->y},
+		{rect->width, rect->height},
+		{rect->rx, rect->ry},
+	};
+
+	return add_nodes(scene, svg_scene_rect,
+		svg_scene_add_style(scene, style), transform, id, NULL,
+		nodes, sizeof(nodes) / sizeof(nodes[0]));
+}
+
+unsigned int svg_scene_add_use(struct svg_scene *scene, const char *href,
+	float x, float y)
+{
+	return svg_scene_add_styled_use(scene, svg_scene_none, NULL, NULL,
+		href, x, y);
+}
+
+/*
+ * svg_scene_add_styled_use - A use of href with a style index from
+ * svg_scene_add_style() and its own transform, both optional.
+ */
+
+unsigned int svg_scene_add_styled_use(struct svg_scene *scene,
+	unsigned int style, const struct svg_transform *transform,
+	const char *id, const char *href, float x, float y)
+{
+	struct svg_scene_item *item;
+
+	assert(href);
+
+	item = add_item(scene, svg_scene_use, style, transform, id, 1);
+	item->href = add_name(scene, href);
+	scene->x[item->offset] = x;
+	scene->y[item->offset] = y;
+	return item_index(scene, item);
+}
+
+void svg_scene_add_background(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const struct svg_rect *background_rect)
+{
+	assert(is_hex_color(style->fill.color));
+
+	svg_scene_open_group(scene, style, transform, "background");
+	svg_scene_add_rect(scene, style, transform, "background",
+		background_rect);
+	svg_scene_close_group(scene);
+}
+
+/*
+ * svg_scene_add_star - A star polygon with its origin at
+ * star_params->position.
+ */
+
+unsigned int svg_scene_add_star(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct star_params *star_params)
+{
+	struct point_c nodes[2 * unit_star_points_max];
+	struct node_buffer nb;
+	unsigned int count;
+	unsigned int index;
+
+	count = star_place(star_params, nodes);
+	if (count) {
+		return svg_scene_add_polygon(scene, style, transform, id,
+			&star_params->position, nodes, count);
+	}
+
+	polygon_star_setup(star_params, &nb);
+	index = svg_scene_add_polygon(scene, style, transform, id,
+		&star_params->position, nb.nodes, nb.node_count);
+	node_buffer_clean(&nb);
+
+	return index;
+}
+
+static unsigned int remap(unsigned int index, unsigned int base)
+{
+	return (index == svg_scene_none) ? svg_scene_none : index + base;
+}
+
+/*
+ * svg_scene_append - Add all items of src to the end of scene.  Top level
+ * src items go into the currently open scene group.
+ */
+
+void svg_scene_append(struct svg_scene *scene, const struct svg_scene *src)
+{
+	const unsigned int item_base = scene->item_count;
+	const unsigned int point_base = scene->point_count;
+	const unsigned int transform_base = scene->transform_count;
+	const unsigned int names_base = scene->names_len;
+	const unsigned int loops_base = scene->loops_len;
+	unsigned int *style_map;
+	unsigned int i;
+
+	assert(src->group == svg_scene_none);
+	assert(!scene->instanced);
+
+	if (!src->item_count) {
+		return;
+	}
+
+	style_map = mem_alloc((src->style_count + 1) * sizeof(*style_map));
+	for (i = 0; i < src->style_count; i++) {
+		style_map[i] = svg_scene_add_style(scene, &src->styles[i]);
+	}
+
+	add_points(scene, src->point_count);
+	memcpy(scene->x + point_base, src->x,
+		src->point_count * sizeof(*src->x));
+	memcpy(scene->y + point_base, src->y,
+		src->point_count * sizeof(*src->y));
+	if (src->count_max > scene->count_max) {
+		scene->count_max = src->count_max;
+	}
+
+	scene->transforms = vector_grow(scene->transforms,
+		&scene->transform_size,
+		scene->transform_count + src->transform_count,
+		sizeof(*scene->transforms));
+	memcpy(scene->transforms + transform_base, src->transforms,
+		src->transform_count * sizeof(*src->transforms));
+	scene->transform_count += src->transform_count;
+
+	scene->names = vector_grow(scene->names, &scene->names_size,
+		scene->names_len + src->names_len, 1);
+	memcpy(scene->names + names_base, src->names, src->names_len);
+	scene->names_len += src->names_len;
+
+	scene->loops = vector_grow(scene->loops, &scene->loops_size,
+		scene->loops_len + src->loops_len, sizeof(*scene->loops));
+	if (src->loops_len) {
+		memcpy(scene->loops + loops_base, src->loops,
+			src->loops_len * sizeof(*src->loops));
+		scene->loops_len += src->loops_len;
+	}
+
+	scene->items = vector_grow(scene->items, &scene->item_size,
+		scene->item_count + src->item_count, sizeof(*scene->items));
+
+	for (i = 0; i < src->item_count; i++) {
+		const struct svg_scene_item *s = &src->items[i];
+		struct svg_scene_item *d = &scene->items[item_base + i];
+
+		*d = *s;
+		d->parent = (s->parent == svg_scene_none) ? scene->group
+			: s->parent + item_base;
+		d->id = remap(s->id, names_base);
+		d->href = remap(s->href, names_base);
+		d->style = (s->style == svg_scene_none) ? svg_scene_none
+			: style_map[s->style];
+		d->transform = remap(s->transform, transform_base);
+		d->offset = s->offset + point_base;
+		d->instance = svg_scene_none;
+		d->loops = remap(s->loops, loops_base);
+	}
+	scene->item_count += src->item_count;
+
+	mem_free(style_map);
+}
+
+/*
+ * Instancing.  A shape is keyed by kind, style and its points relative to
+ * the first point, so translated copies compare equal.  The first item
+ * with a key is the template; the copies are written as a <use> of it
+ * translated to their origin plus first point.
+ */
+
+static bool is_instance_candidate(const struct svg_scene_item *item)
+{
+	return (item->kind == svg_scene_path
+		|| item->kind == svg_scene_polygon)
+		&& item->transform == svg_scene_none
+		&& !item->culled;
+}
+
+static unsigned int float_bits(float f)
+{
+	unsigned int u;
+
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static unsigned int hash_mix(unsigned int h, unsigned int v)
+{
+	h ^= v;
+	h *= 0x01000193U;
+	return h;
+}
+
+static unsigned int item_hash(const struct svg_scene *scene,
+	const struct svg_scene_item *item)
+{
+	const float *x = scene->x + item->offset;
+	const float *y = scene->y + item->offset;
+	unsigned int h = 0x811c9dc5U;
+	unsigned int i;
+
+	h = hash_mix(h, item->kind);
+	h = hash_mix(h, item->style);
+	h = hash_mix(h, item->count);
+
+	for (i = 1; i < item->count; i++) {
+		h = hash_mix(h, float_bits(x[i] - x[0]));
+		h = hash_mix(h, float_bits(y[i] - y[0]));
+	}
+
+	return h ^ (h >> 16);
+}
+
+static bool item_same_shape(const struct svg_scene *scene,
+	const struct svg_scene_item *a, const struct svg_scene_item *b)
+{
+	const float *ax = scene->x + a->offset;
+	const float *ay = scene->y + a->offset;
+	const float *bx = scene->x + b->offset;
+	const float *by = scene->y + b->offset;
+	unsigned int i;
+
+	if (a->kind != b->kind || a->style != b->style
+		|| a->count != b->count) {
+		return false;
+	}
+
+	for (i = 1; i < a->count; i++) {
+		if (float_bits(ax[i] - ax[0]) != float_bits(bx[i] - bx[0])
+			|| float_bits(ay[i] - ay[0])
+				!= float_bits(by[i] - by[0])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct instance_slot {
+	unsigned int item;
+	unsigned int hash;
+};
+
+/*
+ * svg_scene_instance - Find repeated shapes.  One open addressing hash
+ * table pass over the candidate items, so the cost is linear in the point
+ * count.  Call once the scene is complete.
+ */
+
+void svg_scene_instance(struct svg_scene *scene)
+{
+	struct instance_slot *table;
+	unsigned int *copies;
+	unsigned int candidates;
+	unsigned int defs_size = 0;
+	unsigned int size;
+	unsigned int i;
+
+	assert(scene->group == svg_scene_none);
+
+	if (scene->instanced) {
+		return;
+	}
+	scene->instanced = true;
+
+	for (i = 0, candidates = 0; i < scene->item_count; i++) {
+		candidates += is_instance_candidate(&scene->items[i]);
+	}
+
+	if (candidates < 2) {
+		return;
+	}
+
+	size = 16;
+	while (size < 2 * candidates) {
+		size *= 2;
+	}
+
+	table = mem_alloc(size * sizeof(*table));
+	memset(table, 0xff, size * sizeof(*table));
+
+	// copies[t] counts the items that share template item t.
+	copies = mem_alloc(scene->item_count * sizeof(*copies));
+
+	for (i = 0; i < scene->item_count; i++) {
+		struct svg_scene_item *item = &scene->items[i];
+		unsigned int hash;
+		unsigned int slot;
+
+		if (!is_instance_candidate(item)) {
+			continue;
+		}
+
+		hash = item_hash(scene, item);
+
+		for (slot = hash & (size - 1); ; slot = (slot + 1) & (size - 1)) {
+			const unsigned int t = table[slot].item;
+
+			if (t == svg_scene_none) {
+				table[slot].item = i;
+				table[slot].hash = hash;
+				item->instance = i;
+				break;
+			}
+			if (table[slot].hash == hash
+				&& item_same_shape(scene, &scene->items[t], item)) {
+				item->instance = t;
+				copies[t]++;
+				break;
+			}
+		}
+	}
+
+	mem_free(table);
+
+	/*
+	 * Number the shapes that have copies and clear the rest.  A template
+	 * comes before its copies, so by the time a copy is seen copies[t]
+	 * holds 1 + the defs index of its template.
+	 */
+	for (i = 0; i < scene->item_count; i++) {
+		struct svg_scene_item *item = &scene->items[i];
+		const unsigned int t = item->instance;
+
+		if (t == svg_scene_none) {
+			continue;
+		}
+		if (t == i) {
+			if (!copies[t]) {
+				item->instance = svg_scene_none;
+				continue;
+			}
+			scene->defs = vector_grow(scene->defs, &defs_size,
+				scene->def_count + 1, sizeof(*scene->defs));
+			scene->defs[scene->def_count++] = t;
+			copies[t] = scene->def_count;
+		}
+		item->instance = copies[t] - 1;
+	}
+
+	mem_free(copies);
+}
+
+static void gather_points(const struct svg_scene *scene,
+	const struct svg_scene_item *item, struct point_c *nodes)
+{
+	const float *x = scene->x + item->offset;
+	const float *y = scene->y + item->offset;
+	unsigned int i;
+
+	for (i = 0; i < item->count; i++) {
+		nodes[i].x = x[i] + item->origin.x;
+		nodes[i].y = y[i] + item->origin.y;
+	}
+}
+
+/*
+ * Occlusion culling.  An item is culled when later items in the same group
+ * cover it.  All must be untransformed paths or polygons with an opaque
+ * fill and no stroke.  Every test is conservative, so a culled item is
+ * always fully hidden, but some hidden items are kept.
+ *
+ * Each candidate has a bounding box, a center, the radius of a circle
+ * about the center that holds it (outer) and of one it holds (inner, 0 if
+ * the center is outside it).  A uniform grid of cells indexes candidates
+ * by bounding box.  The later candidates overlapping an item are first
+ * tried one at a time with the circle tests and then exact containment.
+ * Failing that, the item bounding box is split into quadrants down to
+ * cull_depth levels, and each box that meets the item must lie inside one
+ * of the overlapping candidates.  A point of the item outside all of them
+ * stops the search early.
+ */
+
+enum {
+	cull_cover_max = 32,	// overlapping candidates used per item.
+	cull_depth = 5,
+};
+
+struct cull_item {
+	unsigned int item;
+	float x0;
+	float y0;
+	float x1;
+	float y1;
+	struct point_c center;
+	float inner;
+	float outer;
+};
+
+struct cull_grid {
+	float x0;
+	float y0;
+	float cell;
+	unsigned int columns;
+	unsigned int rows;
+	unsigned int *start;	// first entry of each cell, plus end.
+	unsigned int *entries;	// cull_item indices.
+};
+
+/*
+ * is_opaque_shape - An untransformed path or polygon that hides all under
+ * it.
+ */
+
+static bool is_opaque_shape(const struct svg_scene *scene,
+	const struct svg_scene_item *item)
+{
+	const struct svg_style *style;
+
+	if ((item->kind != svg_scene_path && item->kind != svg_scene_polygon)
+		|| item->transform != svg_scene_none
+		|| item->style == svg_scene_none || item->count < 3) {
+		return false;
+	}
+
+	style = &scene->styles[item->style];
+	return is_hex_color(style->fill.color)
+		&& !is_hex_color(style->stroke.color);
+}
+
+static void cull_item_init(struct cull_item *ci, unsigned int index,
+	const struct svg_scene_item *item, const struct point_c *nodes)
+{
+	unsigned int i;
+
+	ci->item = index;
+	ci->x0 = ci->x1 = nodes[0].x;
+	ci->y0 = ci->y1 = nodes[0].y;
+	ci->center.x = 0.0;
+	ci->center.y = 0.0;
+
+	for (i = 0; i < item->count; i++) {
+		ci->x0 = min_f(ci->x0, nodes[i].x);
+		ci->x1 = max_f(ci->x1, nodes[i].x);
+		ci->y0 = min_f(ci->y0, nodes[i].y);
+		ci->y1 = max_f(ci->y1, nodes[i].y);
+		ci->center.x += nodes[i].x;
+		ci->center.y += nodes[i].y;
+	}
+	ci->center.x /= item->count;
+	ci->center.y /= item->count;
+
+	ci->outer = 0.0;
+	for (i = 0; i < item->count; i++) {
+		ci->outer = max_f(ci->outer, hypotf(nodes[i].x - ci->center.x,
+			nodes[i].y - ci->center.y));
+	}
+
+	ci->inner = polygon_contains_point(nodes, item->count, &ci->center)
+		? polygon_edge_distance(nodes, item->count, &ci->center) : 0.0;
+}
+
+static unsigned int cull_cell_index(float v, float v0, float cell,
+	unsigned int limit)
+{
+	const float i = floorf((v - v0) / cell);
+
+	return (i <= 0.0) ? 0 : (i >= limit - 1) ? limit - 1 : (unsigned int)i;
+}
+
+static void cull_grid_init(struct cull_grid *grid,
+	const struct cull_item *cis, unsigned int count)
+{
+	float x1 = cis[0].x1;
+	float y1 = cis[0].y1;
+	float extent = 0.0;
+	unsigned int total;
+	unsigned int *fill;
+	unsigned int pass;
+	unsigned int i;
+
+	grid->x0 = cis[0].x0;
+	grid->y0 = cis[0].y0;
+	grid->entries = NULL;
+
+	for (i = 0; i < count; i++) {
+		grid->x0 = min_f(grid->x0, cis[i].x0);
+		grid->y0 = min_f(grid->y0, cis[i].y0);
+		x1 = max_f(x1, cis[i].x1);
+		y1 = max_f(y1, cis[i].y1);
+		extent += max_f(cis[i].x1 - cis[i].x0, cis[i].y1 - cis[i].y0);
+	}
+
+	// Cells about the mean item size, at most a few per item.
+	grid->cell = max_f(extent / count, 1.0);
+	do {
+		grid->columns = (unsigned int)((x1 - grid->x0) / grid->cell) + 1;
+		grid->rows = (unsigned int)((y1 - grid->y0) / grid->cell) + 1;
+		grid->cell *= 2.0;
+	} while ((unsigned long long)grid->columns * grid->rows
+		> 4ULL * count + 16);
+	grid->cell /= 2.0;
+
+	total = grid->columns * grid->rows;
+	grid->start = mem_alloc((total + 1) * sizeof(*grid->start));
+	fill = mem_alloc(total * sizeof(*fill));
+
+	// Count the entries of each cell, then place them.
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < count; i++) {
+			const unsigned int c0 = cull_cell_index(cis[i].x0,
+				grid->x0, grid->cell, grid->columns);
+			const unsigned int c1 = cull_cell_index(cis[i].x1,
+				grid->x0, grid->cell, grid->columns);
+			const unsigned int r0 = cull_cell_index(cis[i].y0,
+				grid->y0, grid->cell, grid->rows);
+			const unsigned int r1 = cull_cell_index(cis[i].y1,
+				grid->y0, grid->cell, grid->rows);
+			unsigned int r;
+			unsigned int c;
+
+			for (r = r0; r <= r1; r++) {
+				for (c = c0; c <= c1; c++) {
+					const unsigned int cell =
+						r * grid->columns + c;
+
+					if (pass) {
+						grid->entries[fill[cell]++] = i;
+					} else {
+						grid->start[cell + 1]++;
+					}
+				}
+			}
+		}
+
+		if (!pass) {
+			for (i = 0; i < total; i++) {
+				grid->start[i + 1] += grid->start[i];
+				fill[i] = grid->start[i];
+			}
+			grid->entries = mem_alloc((grid->start[total] + 1)
+				* sizeof(*grid->entries));
+		}
+	}
+
+	mem_free(fill);
+}
+
+static void cull_grid_clean(struct cull_grid *grid)
+{
+	mem_free(grid->start);
+	mem_free(grid->entries);
+}
+
+/*
+ * cull_covers - True if candidate b, later than a, hides a.  The circle
+ * tests settle most pairs without the polygon test.
+ */
+
+static bool cull_covers(const struct cull_item *a, const struct cull_item *b,
+	const struct point_c *a_nodes, unsigned int a_count,
+	const struct point_c *b_nodes, unsigned int b_count)
+{
+	const float d = hypotf(a->center.x - b->center.x,
+		a->center.y - b->center.y);
+
+	if (a->x0 < b->x0 || a->x1 > b->x1 || a->y0 < b->y0 || a->y1 > b->y1
+		|| d > b->outer) {
+		return false;
+	}
+
+	if (d + a->outer < b->inner) {
+		return true;
+	}
+
+	return polygon_contains_polygon(b_nodes, b_count, a_nodes, a_count);
+}
+
+/* cull_cover - An item and the later candidates overlapping it. */
+
+struct cull_cover {
+	const struct point_c *nodes;
+	unsigned int count;
+	const struct point_c *cover_nodes;
+	unsigned int cover_offset[cull_cover_max + 1];
+	unsigned int cover_count;
+};
+
+static bool cull_cover_has_point(const struct cull_cover *cover,
+	const struct point_c *p)
+{
+	unsigned int k;
+
+	for (k = 0; k < cover->cover_count; k++) {
+		const unsigned int offset = cover->cover_offset[k];
+
+		if (polygon_contains_point(cover->cover_nodes + offset,
+			cover->cover_offset[k + 1] - offset, p)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * cull_box_hidden - True if the part of the item in the box x0,y0 - x1,y1
+ * is covered.
+ */
+
+static bool cull_box_hidden(const struct cull_cover *cover, float x0,
+	float y0, float x1, float y1, unsigned int depth)
+{
+	const struct point_c mid = {(x0 + x1) / 2.0, (y0 + y1) / 2.0};
+	unsigned int k;
+
+	if (!polygon_meets_box(cover->nodes, cover->count, x0, y0, x1, y1)) {
+		return true;
+	}
+
+	if (polygon_contains_point(cover->nodes, cover->count, &mid)
+		&& !cull_cover_has_point(cover, &mid)) {
+		return false;
+	}
+
+	for (k = 0; k < cover->cover_count; k++) {
+		const unsigned int offset = cover->cover_offset[k];
+
+		if (polygon_contains_box(cover->cover_nodes + offset,
+			cover->cover_offset[k + 1] - offset, x0, y0, x1, y1)) {
+			return true;
+		}
+	}
+
+	if (!depth--) {
+		return false;
+	}
+
+	return cull_box_hidden(cover, x0, y0, mid.x, mid.y, depth)
+		&& cull_box_hidden(cover, mid.x, y0, x1, mid.y, depth)
+		&& cull_box_hidden(cover, x0, mid.y, mid.x, y1, depth)
+		&& cull_box_hidden(cover, mid.x, mid.y, x1, y1, depth);
+}
+
+/*
+ * cull_gather - Collect into cover the later candidates that share the
+ * parent of cis[i] and overlap its bounding box.  Returns true if one of
+ * them hides it on its own.
+ */
+
+static bool cull_gather(const struct svg_scene *scene,
+	const struct cull_grid *grid, const struct cull_item *cis,
+	unsigned int i, unsigned int *seen, struct cull_cover *cover,
+	struct point_c *cover_nodes)
+{
+	const struct cull_item *a = &cis[i];
+	const struct svg_scene_item *ia = &scene->items[a->item];
+	const unsigned int c0 = cull_cell_index(a->x0, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int c1 = cull_cell_index(a->x1, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int r0 = cull_cell_index(a->y0, grid->y0, grid->cell,
+		grid->rows);
+	const unsigned int r1 = cull_cell_index(a->y1, grid->y0, grid->cell,
+		grid->rows);
+	unsigned int r;
+	unsigned int c;
+	unsigned int e;
+
+	cover->count = ia->count;
+	cover->cover_nodes = cover_nodes;
+	cover->cover_offset[0] = 0;
+	cover->cover_count = 0;
+
+	for (r = r0; r <= r1; r++) {
+		for (c = c0; c <= c1; c++) {
+			const unsigned int cell = r * grid->columns + c;
+
+			for (e = grid->start[cell]; e < grid->start[cell + 1];
+				e++) {
+				const unsigned int j = grid->entries[e];
+				const struct cull_item *b = &cis[j];
+				const struct svg_scene_item *ib =
+					&scene->items[b->item];
+				struct point_c *b_nodes;
+
+				if (j <= i || seen[j] == i
+					|| ib->parent != ia->parent
+					|| b->x0 > a->x1 || b->x1 < a->x0
+					|| b->y0 > a->y1 || b->y1 < a->y0) {
+					continue;
+				}
+				seen[j] = i;
+
+				b_nodes = cover_nodes
+					+ cover->cover_offset[cover->cover_count];
+				gather_points(scene, ib, b_nodes);
+
+				if (cull_covers(a, b, cover->nodes,
+					cover->count, b_nodes, ib->count)) {
+					return true;
+				}
+
+				if (cover->cover_count < cull_cover_max) {
+					cover->cover_count++;
+					cover->cover_offset[cover->cover_count]
+						= cover->cover_offset[
+						cover->cover_count - 1]
+						+ ib->count;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static unsigned int cull_scan(struct svg_scene *scene,
+	const struct cull_item *cis, unsigned int count,
+	struct point_c *a_nodes, struct point_c *cover_nodes)
+{
+	struct cull_grid grid;
+	struct cull_cover cover;
+	unsigned int *seen;
+	unsigned int culled = 0;
+	unsigned int i;
+
+	cull_grid_init(&grid, cis, count);
+	seen = mem_alloc((count + 1) * sizeof(*seen));
+	memset(seen, 0xff, (count + 1) * sizeof(*seen));
+	cover.nodes = a_nodes;
+
+	for (i = 0; i < count; i++) {
+		const struct cull_item *a = &cis[i];
+		struct svg_scene_item *item = &scene->items[a->item];
+		bool hidden;
+
+		gather_points(scene, item, a_nodes);
+		hidden = cull_gather(scene, &grid, cis, i, seen, &cover,
+			cover_nodes);
+
+		if (!hidden && cover.cover_count
+			&& !(a->inner && !cull_cover_has_point(&cover,
+				&a->center))
+			&& polygon_is_simple(a_nodes, item->count)) {
+			hidden = cull_box_hidden(&cover, a->x0, a->y0, a->x1,
+				a->y1, cull_depth);
+		}
+
+		if (hidden) {
+			item->culled = true;
+			culled++;
+		}
+	}
+
+	mem_free(seen);
+	cull_grid_clean(&grid);
+	return culled;
+}
+
+/*
+ * svg_scene_cull - Mark the items hidden by later items as culled.
+ * Returns the number culled.  Call once the scene is complete and before
+ * it is written.
+ */
+
+unsigned int svg_scene_cull(struct svg_scene *scene)
+{
+	struct cull_item *cis;
+	struct point_c *a_nodes;
+	struct point_c *cover_nodes;
+	unsigned int culled = 0;
+	unsigned int count;
+	unsigned int i;
+
+	assert(scene->group == svg_scene_none);
+	assert(!scene->instanced);
+
+	cis = mem_alloc((scene->item_count + 1) * sizeof(*cis));
+	a_nodes = mem_alloc((scene->count_max + 1) * sizeof(*a_nodes));
+	cover_nodes = mem_alloc((cull_cover_max + 1) * (scene->count_max + 1)
+		* sizeof(*cover_nodes));
+
+	for (i = 0, count = 0; i < scene->item_count; i++) {
+		const struct svg_scene_item *item = &scene->items[i];
+
+		if (is_opaque_shape(scene, item)) {
+			gather_points(scene, item, a_nodes);
+			cull_item_init(&cis[count++], i, item, a_nodes);
+		}
+	}
+
+	if (count > 1) {
+		culled = cull_scan(scene, cis, count, a_nodes, cover_nodes);
+	}
+
+	mem_free(cover_nodes);
+	mem_free(a_nodes);
+	mem_free(cis);
+	return culled;
+}
+
+/*
+ * Flattening.  The opaque shapes of each group go through polygon_flatten()
+ * and the scene is rebuilt with their regions in place of them, at the end
+ * of the group.  A region takes the style of the shape that owns it.  To
+ * merge, the shapes are keyed by style, so touching regions of one style
+ * become one.
+ */
+
+/* copy_item - Add a copy of item of scene src to scene. */
+
+static void copy_item(struct svg_scene *scene, const struct svg_scene *src,
+	const struct svg_scene_item *item)
+{
+	const struct svg_transform *transform =
+		(item->transform == svg_scene_none)
+		? NULL : &src->transforms[item->transform];
+	const unsigned int style = (item->style == svg_scene_none)
+		? svg_scene_none
+		: svg_scene_add_style(scene, &src->styles[item->style]);
+	struct svg_scene_item *d;
+	unsigned int i;
+
+	if (item->kind == svg_scene_group_end) {
+		svg_scene_close_group(scene);
+		return;
+	}
+
+	d = add_item(scene, item->kind, style, transform,
+		svg_scene_name(src, item->id), item->count);
+	d->origin = item->origin;
+	d->culled = item->culled;
+	memcpy(scene->x + d->offset, src->x + item->offset,
+		item->count * sizeof(*scene->x));
+	memcpy(scene->y + d->offset, src->y + item->offset,
+		item->count * sizeof(*scene->y));
+
+	if (item->href != svg_scene_none) {
+		d->href = add_name(scene, svg_scene_name(src, item->href));
+	}
+
+	if (item->loops != svg_scene_none) {
+		const unsigned int len = src->loops[item->loops] + 1;
+
+		scene->loops = vector_grow(scene->loops, &scene->loops_size,
+			scene->loops_len + len, sizeof(*scene->loops));
+		d->loops = scene->loops_len;
+		for (i = 0; i < len; i++) {
+			scene->loops[scene->loops_len++] =
+				src->loops[item->loops + i];
+		}
+	}
+
+	if (item->kind == svg_scene_group || item->kind == svg_scene_defs) {
+		scene->group = item_index(scene, d);
+	}
+}
+
+/*
+ * flatten_group - Add to scene the regions of the opaque shapes of src in
+ * group.  Returns the region count and adds the shape count to
+ * shape_count.
+ */
+
+static unsigned int flatten_group(struct svg_scene *scene,
+	const struct svg_scene *src, unsigned int group, bool merge,
+	unsigned int first_region, unsigned int *shape_count)
+{
+	struct flatten_result result;
+	struct point_c *points;
+	unsigned int *offsets;
+	unsigned int *shapes;
+	unsigned int *keys;
+	unsigned int count;
+	unsigned int i;
+
+	points = mem_alloc((src->point_count + 1) * sizeof(*points));
+	offsets = mem_alloc((src->item_count + 1) * sizeof(*offsets));
+	shapes = mem_alloc((src->item_count + 1) * sizeof(*shapes));
+	keys = mem_alloc((src->item_count + 1) * sizeof(*keys));
+
+	for (i = 0, count = 0; i < src->item_count; i++) {
+		const struct svg_scene_item *item = &src->items[i];
+
+		if (item->parent == group && !item->culled
+			&& is_opaque_shape(src, item)) {
+			gather_points(src, item, points + offsets[count]);
+			keys[count] = item->style;
+			shapes[count++] = i;
+			offsets[count] = offsets[count - 1] + item->count;
+		}
+	}
+
+	*shape_count += count;
+
+	polygon_flatten(points, offsets, merge ? keys : NULL, count,
+		&result);
+
+	for (i = 0; i < result.region_count; i++) {
+		const struct svg_scene_item *owner =
+			&src->items[shapes[result.owners[i]]];
+		const unsigned int first = result.loops[result.regions[i]];
+		const unsigned int loop_count = result.regions[i + 1]
+			- result.regions[i];
+		char id[sizeof("region_4294967295")];
+		struct svg_scene_item *item;
+		unsigned int loop;
+		unsigned int k;
+
+		snprintf(id, sizeof(id), "region_%u", first_region + i);
+		item = add_item(scene, svg_scene_compound,
+			svg_scene_add_style(scene, &src->styles[owner->style]),
+			NULL, id, result.loops[result.regions[i + 1]] - first);
+
+		for (k = 0; k < item->count; k++) {
+			scene->x[item->offset + k] = result.points[first + k].x;
+			scene->y[item->offset + k] = result.points[first + k].y;
+		}
+
+		scene->loops = vector_grow(scene->loops, &scene->loops_size,
+			scene->loops_len + loop_count + 1,
+			sizeof(*scene->loops));
+		item->loops = scene->loops_len;
+		scene->loops[scene->loops_len++] = loop_count;
+		for (loop = result.regions[i]; loop < result.regions[i + 1];
+			loop++) {
+			scene->loops[scene->loops_len++] =
+				result.loops[loop + 1] - result.loops[loop];
+		}
+	}
+
+	count = result.region_count;
+
+	flatten_result_clean(&result);
+	mem_free(keys);
+	mem_free(shapes);
+	mem_free(offsets);
+	mem_free(points);
+	return count;
+}
+
+/*
+ * svg_scene_flatten - Replace the opaque path and polygon items of each
+ * group by the disjoint regions left visible of them, with merge those of
+ * one style joined where they touch.  Returns the number of regions and
+ * sets shape_count to the number of shapes they came from.  Call once the
+ * scene is complete and before it is written.
+ */
+
+unsigned int svg_scene_flatten(struct svg_scene *scene, bool merge,
+	unsigned int *shape_count)
+{
+	const unsigned int top = scene->item_count;
+	struct svg_scene flat;
+	bool *pending;
+	unsigned int regions = 0;
+	unsigned int i;
+
+	assert(scene->group == svg_scene_none);
+	assert(!scene->instanced);
+
+	*shape_count = 0;
+
+	// Groups with opaque shapes, top for those outside any group.
+	pending = mem_alloc((scene->item_count + 1) * sizeof(*pending));
+	for (i = 0; i < scene->item_count; i++) {
+		const struct svg_scene_item *item = &scene->items[i];
+
+		if (is_opaque_shape(scene, item)) {
+			pending[(item->parent == svg_scene_none)
+				? top : item->parent] = true;
+		}
+	}
+
+	svg_scene_init(&flat);
+
+	for (i = 0; i < scene->item_count; i++) {
+		const struct svg_scene_item *item = &scene->items[i];
+
+		if (is_opaque_shape(scene, item)) {
+			continue;
+		}
+		if (item->kind == svg_scene_group_end
+			&& pending[item->parent]) {
+			regions += flatten_group(&flat, scene, item->parent,
+				merge, regions, shape_count);
+		}
+		copy_item(&flat, scene, item);
+	}
+	if (pending[top]) {
+		regions += flatten_group(&flat, scene, svg_scene_none,
+			merge, regions, shape_count);
+	}
+
+	mem_free(pending);
+	svg_scene_clean(scene);
+	*scene = flat;
+	return regions;
+}
+
+/*
+ * Merging.  Opaque shapes of one style are joined into clusters, and each
+ * cluster is written as one item where its last shape was drawn.  The
+ * picture stays the same as long as no shape of another style drawn
+ * between the first and the last shape of a cluster overlaps one of its
+ * shapes.  The overlap test is conservative, it only rules out shapes
+ * whose outlines miss the bounding box of the other.
+ * Any other sibling item keeps the shapes before it apart from those
+ * after it.  The shapes are not made disjoint, so a scene never has more
+ * items after a merge than before it.
+ */
+
+struct merge_shape {
+	unsigned int parent;
+	unsigned int segment;	// last other sibling item before it.
+	unsigned int style;
+	unsigned int cluster;	// union-find link, itself for a root.
+	unsigned int next;	// next shape of the cluster.
+	unsigned int tail;	// of a root, its list end, first and last.
+	unsigned int first;
+	unsigned int last;
+	unsigned int tried;	// of a root, last shape that tried to join.
+};
+
+static unsigned int merge_find(struct merge_shape *shapes, unsigned int i)
+{
+	while (shapes[i].cluster != i) {
+		shapes[i].cluster = shapes[shapes[i].cluster].cluster;
+		i = shapes[i].cluster;
+	}
+	return i;
+}
+
+static bool merge_boxes_meet(const struct cull_item *a,
+	const struct cull_item *b)
+{
+	return a->x0 <= b->x1 && a->x1 >= b->x0 && a->y0 <= b->y1
+		&& a->y1 >= b->y0;
+}
+
+/*
+ * merge_meet - True unless shapes a and b are found apart: their bounding
+ * boxes apart, or either outline outside the bounding box of the other.
+ */
+
+static bool merge_meet(const struct svg_scene *scene,
+	const struct cull_item *a, const struct cull_item *b,
+	struct point_c *nodes)
+{
+	const struct svg_scene_item *ia = &scene->items[a->item];
+	const struct svg_scene_item *ib = &scene->items[b->item];
+
+	if (!merge_boxes_meet(a, b)) {
+		return false;
+	}
+
+	gather_points(scene, ia, nodes);
+	if (!polygon_meets_box(nodes, ia->count, b->x0, b->y0, b->x1, b->y1)) {
+		return false;
+	}
+
+	gather_points(scene, ib, nodes);
+	return polygon_meets_box(nodes, ib->count, a->x0, a->y0, a->x1, a->y1);
+}
+
+/*
+ * merge_blocked - True if a shape of another style, drawn after shape lo
+ * and before shape hi, meets shape m.
+ */
+
+static bool merge_blocked(const struct svg_scene *scene,
+	const struct merge_shape *shapes, const struct cull_grid *grid,
+	const struct cull_item *cis, unsigned int m, unsigned int lo,
+	unsigned int hi, struct point_c *nodes)
+{
+	const struct cull_item *a = &cis[m];
+	const unsigned int c0 = cull_cell_index(a->x0, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int c1 = cull_cell_index(a->x1, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int r0 = cull_cell_index(a->y0, grid->y0, grid->cell,
+		grid->rows);
+	const unsigned int r1 = cull_cell_index(a->y1, grid->y0, grid->cell,
+		grid->rows);
+	unsigned int r;
+	unsigned int c;
+	unsigned int e;
+
+	for (r = r0; r <= r1; r++) {
+		for (c = c0; c <= c1; c++) {
+			const unsigned int cell = r * grid->columns + c;
+
+			for (e = grid->start[cell]; e < grid->start[cell + 1];
+				e++) {
+				const unsigned int j = grid->entries[e];
+
+				if (j > lo && j < hi
+					&& shapes[j].parent == shapes[m].parent
+					&& shapes[j].style != shapes[m].style
+					&& merge_meet(scene, a, &cis[j],
+						nodes)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/* merge_join - Join clusters p and q if nothing drawn between blocks it. */
+
+static void merge_join(const struct svg_scene *scene,
+	struct merge_shape *shapes, const struct cull_grid *grid,
+	const struct cull_item *cis, unsigned int p, unsigned int q,
+	struct point_c *nodes)
+{
+	const unsigned int lo = (shapes[p].first < shapes[q].first)
+		? shapes[p].first : shapes[q].first;
+	const unsigned int hi = (shapes[p].last > shapes[q].last)
+		? shapes[p].last : shapes[q].last;
+	unsigned int m;
+
+	for (m = p; m != svg_scene_none; m = shapes[m].next) {
+		if (merge_blocked(scene, shapes, grid, cis, m, lo, hi,
+			nodes)) {
+			return;
+		}
+	}
+	for (m = q; m != svg_scene_none; m = shapes[m].next) {
+		if (merge_blocked(scene, shapes, grid, cis, m, lo, hi,
+			nodes)) {
+			return;
+		}
+	}
+
+	shapes[q].cluster = p;
+	shapes[shapes[p].tail].next = q;
+	shapes[p].tail = shapes[q].tail;
+	shapes[p].first = lo;
+	shapes[p].last = hi;
+}
+
+/*
+ * merge_shape_join - Join shape b to the earlier clusters of its style
+ * whose shapes meet its bounding box.
+ */
+
+static void merge_shape_join(const struct svg_scene *scene,
+	struct merge_shape *shapes, const struct cull_grid *grid,
+	const struct cull_item *cis, unsigned int b, struct point_c *nodes)
+{
+	const struct cull_item *bi = &cis[b];
+	const unsigned int c0 = cull_cell_index(bi->x0, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int c1 = cull_cell_index(bi->x1, grid->x0, grid->cell,
+		grid->columns);
+	const unsigned int r0 = cull_cell_index(bi->y0, grid->y0, grid->cell,
+		grid->rows);
+	const unsigned int r1 = cull_cell_index(bi->y1, grid->y0, grid->cell,
+		grid->rows);
+	unsigned int r;
+	unsigned int c;
+	unsigned int e;
+
+	for (r = r0; r <= r1; r++) {
+		for (c = c0; c <= c1; c++) {
+			const unsigned int cell = r * grid->columns + c;
+
+			for (e = grid->start[cell]; e < grid->start[cell + 1];
+				e++) {
+				const unsigned int a = grid->entries[e];
+				const struct merge_shape *sa = &shapes[a];
+				unsigned int p;
+				unsigned int q;
+
+				if (a >= b || sa->parent != shapes[b].parent
+					|| sa->segment != shapes[b].segment
+					|| sa->style != shapes[b].style
+					|| !merge_boxes_meet(&cis[a], bi)) {
+					continue;
+				}
+
+				p = merge_find(shapes, a);
+				q = merge_find(shapes, b);
+				if (p == q || shapes[p].tried == b) {
+					continue;
+				}
+				// A failed join fails again for b.
+				shapes[p].tried = b;
+				merge_join(scene, shapes, grid, cis, p, q,
+					nodes);
+			}
+		}
+	}
+}
+
+static void merge_cluster(const struct svg_scene *scene,
+	struct merge_shape *shapes, const struct cull_item *cis,
+	unsigned int count)
+{
+	struct cull_grid grid;
+	struct point_c *nodes;
+	unsigned int b;
+
+	cull_grid_init(&grid, cis, count);
+	nodes = mem_alloc((scene->count_max + 1) * sizeof(*nodes));
+
+	for (b = 0; b < count; b++) {
+		merge_shape_join(scene, shapes, &grid, cis, b, nodes);
+	}
+
+	mem_free(nodes);
+	cull_grid_clean(&grid);
+}
+
+/*
+ * merge_add_cluster - Add to scene the union of the shapes of the cluster
+ * rooted at shape root, as one compound item.  Returns false if the union
+ * is empty.
+ */
+
+static bool merge_add_cluster(struct svg_scene *scene,
+	const struct svg_scene *src, const struct merge_shape *shapes,
+	const struct cull_item *cis, unsigned int root, unsigned int number,
+	struct point_c *points, unsigned int *offsets, unsigned int *keys)
+{
+	const struct svg_scene_item *owner = &src->items[cis[root].item];
+	struct flatten_result result;
+	char id[sizeof("region_4294967295")];
+	struct svg_scene_item *item;
+	bool added;
+	unsigned int count;
+	unsigned int loop;
+	unsigned int m;
+	unsigned int k;
+
+	offsets[0] = 0;
+	for (m = root, count = 0; m != svg_scene_none; m = shapes[m].next) {
+		const struct svg_scene_item *shape = &src->items[cis[m].item];
+
+		gather_points(src, shape, points + offsets[count]);
+		keys[count++] = 0;
+		offsets[count] = offsets[count - 1] + shape->count;
+	}
+
+	polygon_flatten(points, offsets, keys, count, &result);
+
+	added = result.region_count != 0;
+	if (added) {
+		snprintf(id, sizeof(id), "region_%u", number);
+		item = add_item(scene, svg_scene_compound,
+			svg_scene_add_style(scene, &src->styles[owner->style]),
+			NULL, id, result.point_count);
+
+		for (k = 0; k < result.point_count; k++) {
+			scene->x[item->offset + k] = result.points[k].x;
+			scene->y[item->offset + k] = result.points[k].y;
+		}
+
+		scene->loops = vector_grow(scene->loops, &scene->loops_size,
+			scene->loops_len + result.loop_count + 1,
+			sizeof(*scene->loops));
+		item->loops = scene->loops_len;
+		scene->loops[scene->loops_len++] = result.loop_count;
+		for (loop = 0; loop < result.loop_count; loop++) {
+			scene->loops[scene->loops_len++] =
+				result.loops[loop + 1] - result.loops[loop];
+		}
+	}
+
+	flatten_result_clean(&result);
+	return added;
+}
+
+/*
+ * svg_scene_merge - Replace the opaque path and polygon items of one
+ * style by their union where that leaves the picture as it was.  Returns
+ * the number of items they became and sets shape_count to the number of
+ * shapes.  Call once the scene is complete and before it is written.
+ */
+
+unsigned int svg_scene_merge(struct svg_scene *scene,
+	unsigned int *shape_count)
+{
+	const unsigned int top = scene->item_count;
+	struct merge_shape *shapes;
+	struct cull_item *cis;
+	struct point_c *points;
+	unsigned int *offsets;
+	unsigned int *keys;
+	unsigned int *segments;
+	unsigned int *index;
+	struct svg_scene flat;
+	unsigned int merged = 0;
+	unsigned int items = 0;
+	unsigned int count;
+	unsigned int i;
+
+	assert(scene->group == svg_scene_none);
+	assert(!scene->instanced);
+
+	shapes = mem_alloc((scene->item_count + 1) * sizeof(*shapes));
+	cis = mem_alloc((scene->item_count + 1) * sizeof(*cis));
+	points = mem_alloc((scene->point_count + 1) * sizeof(*points));
+	offsets = mem_alloc((scene->item_count + 1) * sizeof(*offsets));
+	keys = mem_alloc((scene->item_count + 1) * sizeof(*keys));
+	// Last other item of each group, top for those outside any group.
+	segments = mem_alloc((scene->item_count + 1) * sizeof(*segments));
+	memset(segments, 0xff, (scene->item_count + 1) * sizeof(*segments));
+	// Shape number of each shape item.
+	index = mem_alloc((scene->item_count + 1) * sizeof(*index));
+
+	for (i = 0, count = 0; i < scene->item_count; i++) {
+		const struct svg_scene_item *item = &scene->items[i];
+		const unsigned int parent = (item->parent == svg_scene_none)
+			? top : item->parent;
+		struct merge_shape *shape = &shapes[count];
+		struct point_c min;
+		struct point_c max;
+
+		if (!is_opaque_shape(scene, item)) {
+			segments[parent] = i;
+			continue;
+		}
+		if (item->culled) {
+			continue;
+		}
+
+		gather_points(scene, item, points);
+		polygon_bounds(points, item->count, &min, &max);
+		cis[count].item = i;
+		cis[count].x0 = min.x;
+		cis[count].y0 = min.y;
+		cis[count].x1 = max.x;
+		cis[count].y1 = max.y;
+
+		shape->parent = parent;
+		shape->segment = segments[parent];
+		shape->style = item->style;
+		shape->cluster = count;
+		shape->next = svg_scene_none;
+		shape->tail = count;
+		shape->first = count;
+		shape->last = count;
+		shape->tried = svg_scene_none;
+		index[i] = count++;
+	}
+
+	*shape_count = count;
+
+	if (count > 1) {
+		merge_cluster(scene, shapes, cis, count);
+	}
+
+	svg_scene_init(&flat);
+
+	for (i = 0; i < scene->item_count; i++) {
+		const struct svg_scene_item *item = &scene->items[i];
+		unsigned int root;
+
+		if (!is_opaque_shape(scene, item)) {
+			copy_item(&flat, scene, item);
+			continue;
+		}
+		if (item->culled) {
+			continue;
+		}
+
+		root = merge_find(shapes, index[i]);
+		if (shapes[root].last != index[i]) {
+			continue;
+		}
+		if (shapes[root].next == svg_scene_none) {
+			copy_item(&flat, scene, item);
+			items++;
+		} else if (merge_add_cluster(&flat, scene, shapes, cis, root,
+			merged, points, offsets, keys)) {
+			merged++;
+			items++;
+		}
+	}
+
+	mem_free(index);
+	mem_free(segments);
+	mem_free(keys);
+	mem_free(offsets);
+	mem_free(points);
+	mem_free(cis);
+	mem_free(shapes);
+
+	svg_scene_clean(scene);
+	*scene = flat;
+	return items;
+}
+
+static const struct svg_style *item_style(const struct svg_writer *writer,
+	const struct svg_scene *scene, const struct svg_scene_item *item,
+	struct svg_style *class_style)
+{
+	if (item->style == svg_scene_none) {
+		return NULL;
+	}
+	if (writer->style_classes) {
+		class_style->style_class = item->style + 1;
+		return class_style;
+	}
+	return &scene->styles[item->style];
+}
+
+static void write_shape(struct svg_writer *writer, enum svg_scene_kind kind,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct point_c *nodes, unsigned int count)
+{
+	if (kind == svg_scene_path) {
+		svg_open_path(writer, style, transform, id);
+		svg_write_path_nodes(writer, nodes, count);
+		svg_close_object(writer);
+		return;
+	}
+
+	assert(kind == svg_scene_polygon);
+	svg_open_polygon(writer, style, transform, id);
+	svg_writer_put_points(writer, nodes, count, writer->minify ? " " : "\n");
+	svg_writer_eol(writer);
+	svg_close_polygon(writer);
+}
+
+enum {instance_id_len = sizeof("inst_4294967295")};
+
+static void instance_id(char *buf, unsigned int instance)
+{
+	snprintf(buf, instance_id_len, "inst_%u", instance);
+}
+
+static void write_item(struct svg_writer *writer,
+	const struct svg_scene *scene, const struct svg_scene_item *item,
+	struct point_c *nodes)
+{
+	const struct svg_transform *transform =
+		(item->transform == svg_scene_none)
+		? NULL : &scene->transforms[item->transform];
+	const char *id = svg_scene_name(scene, item->id);
+	const struct svg_style *style;
+	struct svg_style class_style;
+	struct svg_rect rect;
+
+	if (item->culled) {
+		return;
+	}
+
+	if (item->instance != svg_scene_none && writer->instancing) {
+		char href[instance_id_len];
+
+		instance_id(href, item->instance);
+		svg_write_use_id(writer, id, href,
+			item->origin.x + scene->x[item->offset],
+			item->origin.y + scene->y[item->offset]);
+		return;
+	}
+
+	style = item_style(writer, scene, item, &class_style);
+
+	switch (item->kind) {
+	case svg_scene_group:
+		svg_open_group(writer, style, transform, id);
+		break;
+	case svg_scene_group_end:
+		if (scene->items[item->parent].kind == svg_scene_defs) {
+			svg_close_defs(writer);
+		} else {
+			svg_close_group(writer);
+		}
+		break;
+	case svg_scene_defs:
+		svg_open_defs(writer);
+		break;
+	case svg_scene_path:
+	case svg_scene_polygon:
+		gather_points(scene, item, nodes);
+		write_shape(writer, item->kind, style, transform, id, nodes,
+			item->count);
+		break;
+	case svg_scene_rect:
+		rect.x = scene->x[item->offset];
+		rect.y = scene->y[item->offset];
+		rect.width = scene->x[item->offset + 1];
+		rect.height = scene->y[item->offset + 1];
+		rect.rx = scene->x[item->offset + 2];
+		rect.ry = scene->y[item->offset + 2];
+		svg_write_rect(writer, style, transform, id, &rect);
+		break;
+	case svg_scene_use:
+		svg_write_use_object(writer, style, transform, id,
+			svg_scene_name(scene, item->href),
+			scene->x[item->offset], scene->y[item->offset]);
+		break;
+	case svg_scene_compound:
+		gather_points(scene, item, nodes);
+		svg_open_path(writer, style, transform, id);
+		svg_write_path_loops(writer, nodes,
+			scene->loops + item->loops + 1,
+			scene->loops[item->loops]);
+		svg_close_object(writer);
+		break;
+	default:
+		assert(0);
+	}
+}
+
+/*
+ * write_styles - With style classes enabled on writer, the style sheet that
+ * defines class s<n> for style n.
+ */
+
+static void write_styles(struct svg_writer *writer,
+	const struct svg_scene *scene)
+{
+	unsigned int i;
+
+	if (!writer->style_classes || !scene->style_count) {
+		return;
+	}
+
+	svg_open_style_sheet(writer);
+	for (i = 0; i < scene->style_count; i++) {
+		svg_write_style_rule(writer, &scene->styles[i], i);
+	}
+	svg_close_style_sheet(writer);
+}
+
+/*
+ * write_defs - Each instanced shape as a template element with its points
+ * relative to the first point.
+ */
+
+static void write_defs(struct svg_writer *writer,
+	const struct svg_scene *scene)
+{
+	struct svg_style class_style;
+	struct point_c *nodes;
+	unsigned int d;
+
+	if (!writer->instancing || !scene->def_count) {
+		return;
+	}
+
+	nodes = mem_alloc(scene->count_max * sizeof(*nodes));
+
+	svg_open_defs(writer);
+	for (d = 0; d < scene->def_count; d++) {
+		const struct svg_scene_item *item = &scene->items[scene->defs[d]];
+		const float *x = scene->x + item->offset;
+		const float *y = scene->y + item->offset;
+		char id[instance_id_len];
+		unsigned int i;
+
+		for (i = 0; i < item->count; i++) {
+			nodes[i].x = x[i] - x[0];
+			nodes[i].y = y[i] - y[0];
+		}
+
+		instance_id(id, d);
+		write_shape(writer, item->kind,
+			item_style(writer, scene, item, &class_style), NULL, id,
+			nodes, item->count);
+	}
+	svg_close_defs(writer);
+
+	mem_free(nodes);
+}
+
+/*
+ * svg_scene_write_head - Everything that goes ahead of the scene items:
+ * the style sheet and the instance templates, as enabled on writer.
+ */
+
+void svg_scene_write_head(struct svg_writer *writer, struct svg_scene *scene)
+{
+	if (writer->instancing) {
+		svg_scene_instance(scene);
+	}
+	write_styles(writer, scene);
+	write_defs(writer, scene);
+}
+
+void svg_scene_write(struct svg_writer *writer, struct svg_scene *scene)
+{
+	svg_scene_write_head(writer, scene);
+	svg_scene_write_items(writer, scene, 0, scene->item_count);
+}
+
+/*
+ * svg_scene_write_items - Serialize items [first, last).  Item output is
+ * independent of what was written before it, so ranges can be written
+ * separately (by different threads) and concatenated.
+ */
+
+void svg_scene_write_items(struct svg_writer *writer,
+	const struct svg_scene *scene, unsigned int first, unsigned int last)
+{
+	struct point_c *nodes;
+	unsigned int i;
+
+	assert(first <= last && last <= scene->item_count);
+
+	if (first == last) {
+		return;
+	}
+
+	nodes = mem_alloc((scene->count_max ? scene->count_max : 1)
+		* sizeof(*nodes));
+
+	for (i = first; i < last; i++) {
+		write_item(writer, scene, &scene->items[i], nodes);
+	}
+
+	mem_free(nodes);
+}
@@ -0,0 +1,166 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#if ! defined(_MD_GENERATOR_SVG_SCENE_H)
+#define _MD_GENERATOR_SVG_SCENE_H
+
+#include <limits.h>
+
+#include "svg.h"
+#include "svg-writer.h"
+
+/*
+ * In-memory scene.  Generators build the document into a svg_scene and
+ * svg_scene_write() serializes it in one linear pass over items.
+ *
+ * Point coordinates of all items are kept in the flat x[] and y[] arrays,
+ * each item owning count entries from offset.  Path and polygon points are
+ * relative to the item origin.  Styles, transforms and id strings are
+ * shared tables referenced by index.  Groups are an item that opens the
+ * group and a group_end item that closes it, every item records its
+ * enclosing group in parent.  A defs item opens a group that is written
+ * as <defs>, for elements only referenced by use items.
+ *
+ * svg_scene_instance() finds path and polygon items that are translated
+ * copies of each other.  Each such shape is written once in <defs> and
+ * its copies become <use> elements.
+ *
+ * svg_scene_cull() marks path and polygon items that later siblings
+ * fully cover as culled, and they are not written.
+ *
+ * svg_scene_flatten() replaces overlapping path and polygon items by the
+ * disjoint regions left visible of them, optionally merging touching
+ * regions of one style.  A region is a compound item,
+ * a path of several closed loops, whose entry in the loops table is the
+ * loop count followed by the point count of each loop.
+ *
+ * svg_scene_merge() replaces path and polygon items of one style by their
+ * union as compound items, only where no item of another style drawn
+ * between them overlaps them.  Unlike svg_scene_flatten() the result is
+ * not disjoint, and there are never more items than before.
+ */
+
+enum {svg_scene_none = UINT_MAX};
+
+enum svg_scene_kind {
+	svg_scene_group,
+	svg_scene_group_end,
+	svg_scene_defs,
+	svg_scene_path,
+	svg_scene_polygon,
+	svg_scene_rect,		// points: {x,y}, {width,height}, {rx,ry}.
+	svg_scene_use,		// points: {x,y}.
+	svg_scene_compound,
+};
+
+struct svg_scene_item {
+	enum svg_scene_kind kind;
+	unsigned int parent;	// group item index.
+	unsigned int id;	// names offset.
+	unsigned int href;	// names offset of a use target.
+	unsigned int style;	// styles index.
+	unsigned int transform;	// transforms index.
+	unsigned int offset;	// first x[], y[] entry.
+	unsigned int count;
+	struct point_c origin;
+	unsigned int instance;	// defs index.
+	unsigned int loops;	// loops offset of a compound item.
+	bool culled;
+};
+
+struct svg_scene {
+	float *x;
+	float *y;
+	unsigned int point_count;
+	unsigned int point_size;
+
+	struct svg_scene_item *items;
+	unsigned int item_count;
+	unsigned int item_size;
+
+	struct svg_style *styles;
+	unsigned int style_count;
+	unsigned int style_size;
+
+	struct svg_transform *transforms;
+	unsigned int transform_count;
+	unsigned int transform_size;
+
+	char *names;
+	unsigned int names_len;
+	unsigned int names_size;
+
+	unsigned int *loops;
+	unsigned int loops_len;
+	unsigned int loops_size;
+
+	unsigned int *defs;	// template item of each instance.
+	unsigned int def_count;
+	bool instanced;
+
+	unsigned int group;	// currently open group item.
+	unsigned int count_max;	// largest item point count.
+};
+
+void svg_scene_init(struct svg_scene *scene);
+void svg_scene_clean(struct svg_scene *scene);
+
+unsigned int svg_scene_add_style(struct svg_scene *scene,
+	const struct svg_style *style);
+
+unsigned int svg_scene_open_group(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id);
+void svg_scene_close_group(struct svg_scene *scene);
+unsigned int svg_scene_open_defs(struct svg_scene *scene);
+
+unsigned int svg_scene_add_path(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count);
+unsigned int svg_scene_add_styled_path(struct svg_scene *scene,
+	unsigned int style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count);
+unsigned int svg_scene_add_polygon(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct point_c *origin,
+	const struct point_c *nodes, unsigned int count);
+unsigned int svg_scene_add_rect(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct svg_rect *rect);
+unsigned int svg_scene_add_use(struct svg_scene *scene, const char *href,
+	float x, float y);
+unsigned int svg_scene_add_styled_use(struct svg_scene *scene,
+	unsigned int style, const struct svg_transform *transform,
+	const char *id, const char *href, float x, float y);
+
+void svg_scene_add_background(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const struct svg_rect *background_rect);
+unsigned int svg_scene_add_star(struct svg_scene *scene,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const struct star_params *star_params);
+
+void svg_scene_append(struct svg_scene *scene, const struct svg_scene *src);
+
+void svg_scene_instance(struct svg_scene *scene);
+unsigned int svg_scene_cull(struct svg_scene *scene);
+unsigned int svg_scene_flatten(struct svg_scene *scene, bool merge,
+	unsigned int *shape_count);
+unsigned int svg_scene_merge(struct svg_scene *scene,
+	unsigned int *shape_count);
+
+void svg_scene_write_head(struct svg_writer *writer, struct svg_scene *scene);
+void svg_scene_write_items(struct svg_writer *writer,
+	const struct svg_scene *scene, unsigned int first, unsigned int last);
+void svg_scene_write(struct svg_writer *writer, struct svg_scene *scene);
+
+static inline const char *svg_scene_name(const struct svg_scene *scene,
+	unsigned int offset)
+{
+	return (offset == svg_scene_none) ? NULL : scene->names + offset;
+}
+
+#endif /* _MD_GENERATOR_SVG_SCENE_H */
@@ -6,10 +6,15 @@
 #define _MD_GENERATOR_SVG_UTILS_H
 
 #include "config-file.h"
+#include "format.h"
 #include "geometry.h"
 #include "log.h"
 #include "mem.h"
+#include "random.h"
 #include "svg.h"
+#include "svg-scene.h"
+#include "svg-writer.h"
 #include "util.h"
+#include "vector.h"
 
 #endif /* _MD_GENERATOR_SVG_UTILS_H */
@@ -0,0 +1,574 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+# define SVG_WRITER_ZLIB
+# include <zlib.h>
+#endif
+
+#include "log.h"
+#include "mem.h"
+#include "svg-writer.h"
+
+void svg_writer_init(struct svg_writer *writer, FILE *stream, size_t size)
+{
+	assert(writer);
+
+	if (!size) {
+		size = svg_writer_default_size;
+	}
+
+	writer->stream = stream;
+	writer->buf = mem_alloc_uninit(size);
+	writer->size = size;
+	writer->len = 0;
+	writer->own_buf = true;
+	writer->precision = format_precision_default;
+	writer->minify = false;
+	writer->style_classes = false;
+	writer->instancing = true;
+	writer->deflate = NULL;
+	writer->map_fd = -1;
+	writer->map_size = 0;
+	writer->memory = false;
+}
+
+void svg_writer_init_buffer(struct svg_writer *writer, FILE *stream,
+	char *buf, size_t size)
+{
+	assert(writer);
+	assert(buf);
+	assert(size);
+
+	writer->stream = stream;
+	writer->buf = buf;
+	writer->size = size;
+	writer->len = 0;
+	writer->own_buf = false;
+	writer->precision = format_precision_default;
+	writer->minify = false;
+	writer->style_classes = false;
+	writer->instancing = true;
+	writer->deflate = NULL;
+	writer->map_fd = -1;
+	writer->map_size = 0;
+	writer->memory = false;
+}
+
+static size_t page_round(size_t size)
+{
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) / page * page;
+}
+
+static char *map_file(int fd, size_t size)
+{
+	char *buf;
+
+	if (ftruncate(fd, size)) {
+		return NULL;
+	}
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	return (buf == MAP_FAILED) ? NULL : buf;
+}
+
+/*
+ * svg_writer_init_map - Write directly into a mapping of the regular file
+ * behind stream, which must be opened for reading and writing.  size is
+ * the expected upper bound of the output; the mapping is extended if it
+ * turns out to be too small.  Falls back to svg_writer_init() for pipes,
+ * terminals and anything else that can't be mapped.
+ */
+
+void svg_writer_init_map(struct svg_writer *writer, FILE *stream,
+	size_t size)
+{
+	struct stat st;
+	char *buf;
+	int fd;
+
+	assert(writer);
+
+	size = page_round(size ? size : svg_writer_default_size);
+	fd = fileno(stream);
+
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)
+		|| !(buf = map_file(fd, size))) {
+		debug("map failed, using stream: %s\n", strerror(errno));
+		svg_writer_init(writer, stream, 0);
+		return;
+	}
+
+	svg_writer_init_buffer(writer, stream, buf, size);
+	writer->map_fd = fd;
+	writer->map_size = size;
+}
+
+static void map_grow(struct svg_writer *writer, size_t len)
+{
+	size_t size;
+
+	if (writer->map_size - writer->len >= len) {
+		// Extend again after a svg_writer_finish() trim.
+		if (ftruncate(writer->map_fd, writer->map_size)) {
+			error("Truncate %lu failed: %s.\n",
+				(unsigned long)writer->map_size,
+				strerror(errno));
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+		writer->size = writer->map_size;
+		return;
+	}
+
+	size = page_round(writer->len + len);
+	if (size < 2 * writer->map_size) {
+		size = 2 * writer->map_size;
+	}
+
+	munmap(writer->buf, writer->map_size);
+	writer->buf = map_file(writer->map_fd, size);
+
+	if (!writer->buf) {
+		error("Map %lu failed: %s.\n", (unsigned long)size,
+			strerror(errno));
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	writer->size = size;
+	writer->map_size = size;
+}
+
+static void map_trim(struct svg_writer *writer)
+{
+	if (ftruncate(writer->map_fd, writer->len)) {
+		error("Truncate %lu failed: %s.\n", (unsigned long)writer->len,
+			strerror(errno));
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	// Anything written after this has to grow the file again first.
+	writer->size = writer->len;
+}
+
+/*
+ * svg_writer_init_memory - Collect output in a buffer that grows as needed
+ * and is never written out.  The caller takes the result from buf and len.
+ */
+
+void svg_writer_init_memory(struct svg_writer *writer, size_t size)
+{
+	svg_writer_init(writer, NULL, size);
+	writer->memory = true;
+}
+
+static void memory_grow(struct svg_writer *writer, size_t len)
+{
+	size_t size;
+	char *buf;
+
+	if (writer->size - writer->len >= len) {
+		return;
+	}
+
+	size = writer->len + len;
+	if (size < 2 * writer->size) {
+		size = 2 * writer->size;
+	}
+
+	buf = mem_alloc_uninit(size);
+	memcpy(buf, writer->buf, writer->len);
+	mem_free(writer->buf);
+
+	writer->buf = buf;
+	writer->size = size;
+}
+
+/* svg_writer_grow - Make room in a mapped or memory writer. */
+
+static bool svg_writer_grow(struct svg_writer *writer, size_t len)
+{
+	if (writer->map_fd >= 0) {
+		map_grow(writer, len);
+		return true;
+	}
+	if (writer->memory) {
+		memory_grow(writer, len);
+		return true;
+	}
+	return false;
+}
+
+static void stream_write(FILE *stream, const void *data, size_t len)
+{
+	if (!len) {
+		return;
+	}
+
+	if (fwrite(data, 1, len, stream) != len) {
+		error("Write %lu failed: %s.\n", (unsigned long)len,
+			strerror(errno));
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Streaming gzip stage.  Every flush of the writer buffer is fed through
+ * deflate() and the compressed output is written in out_chunk pieces, so
+ * memory use is the writer buffer plus the fixed zlib state.
+ */
+
+#if defined(SVG_WRITER_ZLIB)
+
+enum {out_chunk = 64U * 1024U};
+
+struct svg_deflate {
+	z_stream zs;
+	unsigned char out[out_chunk];
+};
+
+static void svg_deflate_run(struct svg_writer *writer, const char *data,
+	size_t len, int flush)
+{
+	struct svg_deflate *d = writer->deflate;
+	int result;
+
+	d->zs.next_in = (unsigned char *)data;
+	d->zs.avail_in = len;
+
+	do {
+		size_t out_len;
+
+		d->zs.next_out = d->out;
+		d->zs.avail_out = sizeof(d->out);
+
+		result = deflate(&d->zs, flush);
+
+		if (result == Z_STREAM_ERROR) {
+			error("Deflate failed: %s.\n", d->zs.msg);
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+
+		out_len = sizeof(d->out) - d->zs.avail_out;
+		stream_write(writer->stream, d->out, out_len);
+	} while (d->zs.avail_out == 0);
+
+	assert(d->zs.avail_in == 0);
+	(void)result;
+}
+
+void svg_writer_compress(struct svg_writer *writer, int level)
+{
+	struct svg_deflate *d;
+
+	assert(!writer->deflate);
+	assert(!writer->len);
+
+	if (level < 0 || level > svg_writer_compress_max) {
+		error("Bad compression level %d (max %d).\n", level,
+			svg_writer_compress_max);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	d = mem_alloc(sizeof(*d));
+
+	// windowBits 15 + 16 selects a gzip wrapper.
+	if (deflateInit2(&d->zs, level, Z_DEFLATED, 15 + 16, 8,
+		Z_DEFAULT_STRATEGY) != Z_OK) {
+		error("Deflate init failed: %s.\n", d->zs.msg);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	writer->deflate = d;
+}
+
+static void svg_deflate_finish(struct svg_writer *writer)
+{
+	struct svg_deflate *d = writer->deflate;
+
+	svg_deflate_run(writer, NULL, 0, Z_FINISH);
+	deflateEnd(&d->zs);
+	mem_free(d);
+	writer->deflate = NULL;
+}
+
+#else
+
+void svg_writer_compress(struct svg_writer *writer, int level)
+{
+	(void)writer;
+	(void)level;
+
+	error("Compressed output not supported, rebuild with zlib.\n");
+	assert(0);
+	exit(EXIT_FAILURE);
+}
+
+static void svg_deflate_finish(struct svg_writer *writer)
+{
+	(void)writer;
+}
+
+#endif
+
+bool svg_writer_is_svgz(const char *file_name)
+{
+	static const char ext[] = ".svgz";
+	const size_t len = strlen(file_name);
+
+	return len >= sizeof(ext) - 1
+		&& !strcmp(file_name + len - (sizeof(ext) - 1), ext);
+}
+
+void svg_writer_set_precision(struct svg_writer *writer,
+	unsigned int precision)
+{
+	if (precision > format_precision_max) {
+		error("Bad precision %u (max %u).\n", precision,
+			format_precision_max);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+	writer->precision = precision;
+}
+
+/* svg_writer_finish - End of document, trim a mapped file to size. */
+
+void svg_writer_finish(struct svg_writer *writer)
+{
+	if (writer->map_fd >= 0) {
+		map_trim(writer);
+		return;
+	}
+	svg_writer_flush(writer);
+}
+
+void svg_writer_clean(struct svg_writer *writer)
+{
+	if (writer->map_fd >= 0) {
+		map_trim(writer);
+		munmap(writer->buf, writer->map_size);
+		writer->map_fd = -1;
+		writer->map_size = 0;
+		writer->buf = NULL;
+		writer->size = 0;
+		return;
+	}
+
+	svg_writer_flush(writer);
+
+	if (writer->deflate) {
+		svg_deflate_finish(writer);
+	}
+
+	if (writer->stream) {
+		fflush(writer->stream);
+	}
+
+	if (writer->own_buf) {
+		mem_free(writer->buf);
+	}
+	writer->buf = NULL;
+	writer->size = 0;
+}
+
+static void svg_writer_out(struct svg_writer *writer, const char *data,
+	size_t len)
+{
+#if defined(SVG_WRITER_ZLIB)
+	if (writer->deflate) {
+		if (len) {
+			svg_deflate_run(writer, data, len, Z_NO_FLUSH);
+		}
+		return;
+	}
+#endif
+
+	stream_write(writer->stream, data, len);
+}
+
+void svg_writer_set_minify(struct svg_writer *writer, bool minify)
+{
+	writer->minify = minify;
+}
+
+/*
+ * svg_writer_set_style_classes - Have svg_scene_write() put styles in a
+ * style sheet and reference them by class.
+ */
+
+void svg_writer_set_style_classes(struct svg_writer *writer,
+	bool style_classes)
+{
+	writer->style_classes = style_classes;
+}
+
+/*
+ * svg_writer_set_instancing - Have svg_scene_write() put repeated shapes in
+ * <defs> and write each copy as a <use>.  On by default.
+ */
+
+void svg_writer_set_instancing(struct svg_writer *writer, bool instancing)
+{
+	writer->instancing = instancing;
+}
+
+void svg_writer_flush(struct svg_writer *writer)
+{
+	if (writer->map_fd >= 0 || writer->memory) {
+		return;
+	}
+
+	svg_writer_out(writer, writer->buf, writer->len);
+	writer->len = 0;
+}
+
+void _svg_writer_write(struct svg_writer *writer, const char *data,
+	size_t len)
+{
+	if (svg_writer_grow(writer, len)) {
+		memcpy(writer->buf + writer->len, data, len);
+		writer->len += len;
+		return;
+	}
+
+	svg_writer_flush(writer);
+
+	if (len >= writer->size) {
+		svg_writer_out(writer, data, len);
+		return;
+	}
+
+	memcpy(writer->buf, data, len);
+	writer->len = len;
+}
+
+char *_svg_writer_reserve(struct svg_writer *writer, size_t len)
+{
+	if (svg_writer_grow(writer, len)) {
+		return writer->buf + writer->len;
+	}
+
+	if (len > writer->size) {
+		error("Reserve %lu exceeds buffer.\n", (unsigned long)len);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	svg_writer_flush(writer);
+	return writer->buf;
+}
+
+void svg_writer_printf(struct svg_writer *writer, const char *fmt, ...)
+{
+	va_list ap;
+	size_t avail;
+	int len;
+
+	avail = writer->size - writer->len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(writer->buf + writer->len, avail, fmt, ap);
+	va_end(ap);
+
+	if (len < 0) {
+		error("Format '%s' failed.\n", fmt);
+		assert(0);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((size_t)len < avail) {
+		writer->len += len;
+		return;
+	}
+
+	if (!svg_writer_grow(writer, len + 1)) {
+		svg_writer_flush(writer);
+	}
+
+	avail = writer->size - writer->len;
+
+	if ((size_t)len < avail) {
+		va_start(ap, fmt);
+		vsnprintf(writer->buf + writer->len, avail, fmt, ap);
+		va_end(ap);
+		writer->len += len;
+		return;
+	}
+
+	{
+		char *big;
+
+		va_start(ap, fmt);
+		len = vasprintf(&big, fmt, ap);
+		va_end(ap);
+
+		if (len < 0) {
+			error("Format '%s' failed.\n", fmt);
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+
+		svg_writer_out(writer, big, len);
+		free(big);
+	}
+}
+
+void svg_writer_put_points(struct svg_writer *writer,
+	const struct point_c *points, unsigned int count, const char *sep)
+{
+	const size_t sep_len = strlen(sep);
+	const size_t point_len = format_point_len(sep_len);
+
+	while (count) {
+		unsigned int chunk;
+		char *p;
+
+		chunk = (writer->size - writer->len) / point_len;
+
+		if (!chunk) {
+			_svg_writer_reserve(writer, point_len);
+			chunk = (writer->size - writer->len) / point_len;
+			assert(chunk);
+		}
+		if (chunk > count) {
+			chunk = count;
+		}
+
+		p = writer->buf + writer->len;
+		writer->len += format_points(p, points, chunk,
+			writer->precision, sep);
+
+		points += chunk;
+		count -= chunk;
+
+		if (count) {
+			svg_writer_write(writer, sep, sep_len);
+		}
+	}
+}
@@ -0,0 +1,155 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#if ! defined(_MD_GENERATOR_SVG_WRITER_H)
+#define _MD_GENERATOR_SVG_WRITER_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "format.h"
+
+/*
+ * Buffered output sink for the svg layer.  All svg_* writers append into
+ * buf, which is handed to stream only when full or on svg_writer_flush().
+ * A writer set up with svg_writer_init_map() instead uses a shared mapping
+ * of the output file as buf, so nothing is copied or written until the
+ * file is trimmed to its final length by svg_writer_finish().
+ * svg_writer_init_memory() writers have no stream and just grow buf.
+ *
+ * A writer is not locked, each thread needs its own.
+ */
+
+enum {svg_writer_default_size = 1024U * 1024U};
+
+enum {
+	svg_writer_compress_off = -1,
+	svg_writer_compress_default = 6,
+	svg_writer_compress_max = 9,
+};
+
+struct svg_deflate;
+
+struct svg_writer {
+	FILE *stream;
+	char *buf;
+	size_t size;
+	size_t len;
+	bool own_buf;
+	unsigned int precision;
+	bool minify;
+	bool style_classes;
+	bool instancing;
+	struct svg_deflate *deflate;
+	int map_fd;		// -1 unless buf maps the output file.
+	size_t map_size;
+	bool memory;
+};
+
+void svg_writer_init(struct svg_writer *writer, FILE *stream, size_t size);
+void svg_writer_init_buffer(struct svg_writer *writer, FILE *stream,
+	char *buf, size_t size);
+void svg_writer_init_map(struct svg_writer *writer, FILE *stream,
+	size_t size);
+void svg_writer_init_memory(struct svg_writer *writer, size_t size);
+void svg_writer_finish(struct svg_writer *writer);
+void svg_writer_clean(struct svg_writer *writer);
+
+void svg_writer_set_precision(struct svg_writer *writer,
+	unsigned int precision);
+void svg_writer_set_minify(struct svg_writer *writer, bool minify);
+void svg_writer_set_style_classes(struct svg_writer *writer,
+	bool style_classes);
+void svg_writer_set_instancing(struct svg_writer *writer, bool instancing);
+void svg_writer_compress(struct svg_writer *writer, int level);
+bool svg_writer_is_svgz(const char *file_name);
+
+void svg_writer_flush(struct svg_writer *writer);
+void _svg_writer_write(struct svg_writer *writer, const char *data,
+	size_t len);
+char *_svg_writer_reserve(struct svg_writer *writer, size_t len);
+void __attribute__ ((format (printf, 2, 3)))
+	svg_writer_printf(struct svg_writer *writer, const char *fmt, ...);
+void svg_writer_put_points(struct svg_writer *writer,
+	const struct point_c *points, unsigned int count, const char *sep);
+
+static inline void svg_writer_write(struct svg_writer *writer,
+	const char *data, size_t len)
+{
+	if (writer->size - writer->len < len) {
+		_svg_writer_write(writer, data, len);
+		return;
+	}
+	memcpy(writer->buf + writer->len, data, len);
+	writer->len += len;
+}
+
+static inline void svg_writer_puts(struct svg_writer *writer, const char *str)
+{
+	svg_writer_write(writer, str, strlen(str));
+}
+
+static inline void svg_writer_putc(struct svg_writer *writer, char c)
+{
+	if (writer->len == writer->size) {
+		_svg_writer_write(writer, &c, 1);
+		return;
+	}
+	writer->buf[writer->len++] = c;
+}
+
+/*
+ * svg_writer_reserve - Get room for up to len bytes at the buffer tail.
+ * The caller formats directly into the returned pointer and then calls
+ * svg_writer_commit() with the count actually used.
+ */
+
+static inline char *svg_writer_reserve(struct svg_writer *writer, size_t len)
+{
+	if (writer->size - writer->len < len) {
+		return _svg_writer_reserve(writer, len);
+	}
+	return writer->buf + writer->len;
+}
+
+static inline void svg_writer_commit(struct svg_writer *writer, size_t len)
+{
+	writer->len += len;
+}
+
+/* svg_writer_rewind - Drop the contents of a memory writer. */
+
+static inline void svg_writer_rewind(struct svg_writer *writer)
+{
+	assert(writer->memory);
+	writer->len = 0;
+}
+
+/* svg_writer_eol - Optional line break, dropped in minify mode. */
+
+static inline void svg_writer_eol(struct svg_writer *writer)
+{
+	if (!writer->minify) {
+		svg_writer_putc(writer, '\n');
+	}
+}
+
+static inline void svg_writer_put_float(struct svg_writer *writer, float value)
+{
+	char *p = svg_writer_reserve(writer, format_float_len);
+
+	svg_writer_commit(writer, format_float(p, value, writer->precision));
+}
+
+static inline void svg_writer_put_unsigned(struct svg_writer *writer,
+	unsigned int value)
+{
+	char *p = svg_writer_reserve(writer, format_float_len);
+
+	svg_writer_commit(writer, format_fixed(p, value, 0));
+}
+
+#endif /* _MD_GENERATOR_SVG_WRITER_H */
@@ -10,20 +10,21 @@
 #endif
 
 #include <assert.h>
+#include <limits.h>
 
 #include "log.h"
 #include "svg.h"
 
-static FILE *debug_stream;
+static __thread struct svg_writer *debug_writer;
 
-FILE *svg_debug_stream()
+struct svg_writer *svg_debug_writer(void)
 {
-	return debug_stream;
+	return debug_writer;
 }
 
-void svg_debug_stream_set(FILE *stream)
+void svg_debug_writer_set(struct svg_writer *writer)
 {
-	debug_stream = stream;
+	debug_writer = writer;
 }
 
 struct svg_fill *svg_fill_set(struct svg_fill *fill, const char *color)
@@ -55,9 +56,45 @@ struct svg_stroke *svg_stroke_set(struct svg_stroke *stroke, const char *color,
 	return stroke;
 }
 
-void svg_open_svg(FILE *stream, const struct svg_rect *background_rect)
+static void svg_write_view_box(struct svg_writer *writer,
+	const struct svg_rect *background_rect)
 {
-	fprintf(stream, "<svg\n"
+	svg_writer_put_float(writer, background_rect->x);
+	svg_writer_putc(writer, ' ');
+	svg_writer_put_float(writer, background_rect->y);
+	svg_writer_putc(writer, ' ');
+	svg_writer_put_float(writer, background_rect->width);
+	svg_writer_putc(writer, ' ');
+	svg_writer_put_float(writer, background_rect->height);
+	svg_writer_putc(writer, '"');
+}
+
+/*
+ * Minified documents only declare the default namespace: <use> references
+ * are written with a plain SVG 2 href and no metadata block is emitted.
+ */
+
+static void svg_open_svg_minify(struct svg_writer *writer,
+	const struct svg_rect *background_rect)
+{
+	svg_writer_puts(writer, "<svg xmlns=\"http://www.w3.org/2000/svg\"");
+
+	if (background_rect) {
+		svg_writer_puts(writer, " viewBox=\"");
+		svg_write_view_box(writer, background_rect);
+	}
+	svg_writer_putc(writer, '>');
+}
+
+void svg_open_svg(struct svg_writer *writer,
+	const struct svg_rect *background_rect)
+{
+	if (writer->minify) {
+		svg_open_svg_minify(writer, background_rect);
+		return;
+	}
+
+	svg_writer_puts(writer, "<svg\n"
 		"xmlns=\"http://www.w3.org/2000/svg\"\n"
 		"xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
 		"xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
@@ -66,186 +103,620 @@ void svg_open_svg(FILE *stream, const struct svg_rect *background_rect)
 	);
 
 	if (background_rect) {
-		fprintf(stream, "\n"
+		svg_writer_puts(writer, "\n"
 //			"  width=\"%f\"\n"
 //			"  height=\"%f\"\n"
-			"  viewBox=\"%f %f %f %f\"",
-//			background_rect->width, background_rect->width,
-			background_rect->x, background_rect->y,
-			background_rect->width, background_rect->height);
+			"  viewBox=\"");
+		svg_write_view_box(writer, background_rect);
 	}
-	fprintf(stream, ">\n");
+	svg_writer_puts(writer, ">\n");
 
-	fprintf(stream, "<metadata>\n"
+	svg_writer_puts(writer, "<metadata>\n"
 		" <rdf:RDF>\n"
 		" </rdf:RDF>\n"
 		"</metadata>\n");
 }
 
-void svg_close_svg(FILE *stream)
+void svg_close_svg(struct svg_writer *writer)
+{
+	svg_writer_puts(writer, "</svg>");
+	svg_writer_eol(writer);
+	svg_writer_finish(writer);
+}
+
+void svg_write_comment(struct svg_writer *writer, const char *text)
 {
-	fprintf(stream, "</svg>\n");
+	if (writer->minify) {
+		return;
+	}
+
+	svg_writer_puts(writer, "<!--\n");
+	svg_writer_puts(writer, text);
+	svg_writer_puts(writer, "-->\n");
 }
 
-void svg_write_comment(FILE *stream, const char *text)
+void svg_open_attr(struct svg_writer *writer, const char *name)
 {
-	fprintf(stream, "<!--\n%s-->\n", text);
+	if (writer->minify) {
+		svg_writer_putc(writer, ' ');
+	}
+	svg_writer_puts(writer, name);
+	svg_writer_puts(writer, "=\"");
 }
 
-static void svg_write_style(FILE *stream, const struct svg_style *style)
+void svg_close_attr(struct svg_writer *writer)
+{
+	svg_writer_putc(writer, '"');
+	svg_writer_eol(writer);
+}
+
+static void svg_write_attr(struct svg_writer *writer, const char *name,
+	const char *value)
+{
+	svg_open_attr(writer, name);
+	svg_writer_puts(writer, value);
+	svg_close_attr(writer);
+}
+
+static void svg_write_float_attr(struct svg_writer *writer, const char *name,
+	float value, const char *end)
+{
+	svg_open_attr(writer, name);
+	svg_writer_put_float(writer, value);
+	svg_writer_putc(writer, '"');
+	if (!writer->minify) {
+		svg_writer_puts(writer, end);
+	}
+}
+
+static void svg_write_pair(struct svg_writer *writer, const char *name,
+	float a, float b, bool first)
+{
+	if (writer->minify && !first) {
+		svg_writer_putc(writer, ' ');
+	}
+	svg_writer_puts(writer, name);
+	svg_writer_putc(writer, '(');
+	svg_writer_put_float(writer, a);
+	svg_writer_putc(writer, ' ');
+	svg_writer_put_float(writer, b);
+	svg_writer_putc(writer, ')');
+	svg_writer_eol(writer);
+}
+
+static void svg_write_class_name(struct svg_writer *writer,
+	unsigned int style_class)
+{
+	svg_writer_putc(writer, 's');
+	svg_writer_put_unsigned(writer, style_class);
+}
+
+/*
+ * svg_write_style - Style as a class reference when it has a style_class,
+ * else as fill and stroke attributes.
+ */
+
+static void svg_write_style(struct svg_writer *writer,
+	const struct svg_style *style)
 {
 	if (!style) {
 		return;
 	}
 
+	if (style->style_class) {
+		svg_open_attr(writer, "class");
+		svg_write_class_name(writer, style->style_class - 1);
+		svg_close_attr(writer);
+		return;
+	}
+
+	if (is_hex_color(style->fill.color)) {
+		svg_write_attr(writer, "fill", style->fill.color);
+	}
+
+	if (is_hex_color(style->stroke.color)) {
+		svg_open_attr(writer, "stroke");
+		svg_writer_puts(writer, style->stroke.color);
+		svg_writer_puts(writer, "\" stroke-width=\"");
+		svg_writer_put_unsigned(writer, style->stroke.width);
+		svg_close_attr(writer);
+	}
+}
+
+void svg_open_defs(struct svg_writer *writer)
+{
+	svg_writer_puts(writer, "<defs>");
+	svg_writer_eol(writer);
+}
+
+void svg_close_defs(struct svg_writer *writer)
+{
+	svg_writer_puts(writer, "</defs>");
+	svg_writer_eol(writer);
+}
+
+void svg_open_style_sheet(struct svg_writer *writer)
+{
+	svg_writer_puts(writer, "<style>");
+	svg_writer_eol(writer);
+}
+
+void svg_close_style_sheet(struct svg_writer *writer)
+{
+	svg_writer_puts(writer, "</style>");
+	svg_writer_eol(writer);
+}
+
+/* svg_write_style_rule - CSS rule for class number style_class. */
+
+void svg_write_style_rule(struct svg_writer *writer,
+	const struct svg_style *style, unsigned int style_class)
+{
+	const char *sep = "";
+
+	svg_writer_putc(writer, '.');
+	svg_write_class_name(writer, style_class);
+	svg_writer_puts(writer, writer->minify ? "{" : " {");
+
 	if (is_hex_color(style->fill.color)) {
-		fprintf(stream, "fill=\"%s\"\n", style->fill.color);
+		svg_writer_puts(writer, "fill:");
+		svg_writer_puts(writer, style->fill.color);
+		sep = ";";
 	}
 
 	if (is_hex_color(style->stroke.color)) {
-		fprintf(stream, "stroke=\"%s\" stroke-width=\"%u\"\n",
-			style->stroke.color, style->stroke.width);
+		svg_writer_puts(writer, sep);
+		svg_writer_puts(writer, "stroke:");
+		svg_writer_puts(writer, style->stroke.color);
+		svg_writer_puts(writer, ";stroke-width:");
+		svg_writer_put_unsigned(writer, style->stroke.width);
 	}
+
+	svg_writer_putc(writer, '}');
+	svg_writer_eol(writer);
 }
 
-static void svg_write_transform(FILE *stream,
+static void svg_write_transform(struct svg_writer *writer,
 	const struct svg_transform *transform)
 {
+	bool has_translate;
+	bool has_scale;
+
 	if (!transform) {
 		return;
 	}
 
-	fprintf(stream, "transform=\"\n");
+	has_translate = (transform->translate.x != null_point_c.x);
+	has_scale = (transform->scale.x != null_point_c.x);
+
+	svg_open_attr(writer, "transform");
+	svg_writer_eol(writer);
 
-	if (transform->translate.x != null_point_c.x) {
-		fprintf(stream, "translate(%f %f)\n",
-			transform->translate.x, transform->translate.y);
+	if (has_translate) {
+		svg_write_pair(writer, "translate", transform->translate.x,
+			transform->translate.y, true);
 	}
 
-	if (transform->scale.x != null_point_c.x) {
-		fprintf(stream, "scale(%f %f)\n",
-			transform->scale.x, transform->scale.y);
+	if (has_scale) {
+		svg_write_pair(writer, "scale", transform->scale.x,
+			transform->scale.y, !has_translate);
 	}
 
 	if (transform->rotation.angle) {
-		fprintf(stream, "rotate(%f",
-			transform->rotation.angle);
+		if (writer->minify && (has_translate || has_scale)) {
+			svg_writer_putc(writer, ' ');
+		}
+		svg_writer_puts(writer, "rotate(");
+		svg_writer_put_float(writer, transform->rotation.angle);
 		if (transform->rotation.p.x != null_point_c.x) {
-			fprintf(stream, "%f %f",
-				transform->rotation.p.x,
-				transform->rotation.p.y);
+			svg_writer_putc(writer, ' ');
+			svg_writer_put_float(writer, transform->rotation.p.x);
+			svg_writer_putc(writer, ' ');
+			svg_writer_put_float(writer, transform->rotation.p.y);
 		}
-		fprintf(stream, ")\n");
+		svg_writer_putc(writer, ')');
+		svg_writer_eol(writer);
 	}
 
-	fprintf(stream, "\"\n");
+	svg_close_attr(writer);
 }
 
-void svg_open_group(FILE *stream, const struct svg_style *style,
+void svg_open_group(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id)
 {
-	fprintf(stream, "<g\n");
+	svg_writer_puts(writer, "<g");
+	svg_writer_eol(writer);
 
 	if (id){
-		fprintf(stream, "id=\"%s\"\n", id);
+		svg_write_attr(writer, "id", id);
 	}
-	svg_write_style(stream, style);
-	svg_write_transform(stream, transform);
+	svg_write_style(writer, style);
+	svg_write_transform(writer, transform);
 
-	fprintf(stream, ">\n");
+	svg_writer_putc(writer, '>');
+	svg_writer_eol(writer);
 }
 
-void svg_close_group(FILE *stream)
+void svg_close_group(struct svg_writer *writer)
 {
-	fprintf(stream, "</g>\n");
+	svg_writer_puts(writer, "</g>");
+	svg_writer_eol(writer);
 }
 
-void svg_open_object(FILE *stream, const struct svg_style *style,
+void svg_open_object(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id, const char *type)
 {
-	fprintf(stream, "<%s id=\"%s\"\n", type, id);
-
-	svg_write_style(stream, style);
-	svg_write_transform(stream, transform);
+	svg_writer_putc(writer, '<');
+	svg_writer_puts(writer, type);
+	svg_writer_puts(writer, " id=\"");
+	svg_writer_puts(writer, id);
+	svg_writer_putc(writer, '"');
+	svg_writer_eol(writer);
+
+	svg_write_style(writer, style);
+	svg_write_transform(writer, transform);
 }
 
-void svg_close_object(FILE *stream)
+void svg_close_object(struct svg_writer *writer)
 {
-	fprintf(stream, "/>\n");
+	svg_writer_puts(writer, "/>");
+	svg_writer_eol(writer);
 }
 
-void svg_open_path(FILE *stream, const struct svg_style *style,
+void svg_open_path(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id)
 {
-	svg_open_object(stream, style, transform, id, "path");
+	svg_open_object(writer, style, transform, id, "path");
 }
 
-void svg_open_polygon(FILE *stream, const struct svg_style *style,
+void svg_open_polygon(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id)
 {
-	svg_open_object(stream, style, transform, id, "polygon");
-	fprintf(stream, "points=\"\n");
+	svg_open_object(writer, style, transform, id, "polygon");
+	svg_open_attr(writer, "points");
+	svg_writer_eol(writer);
+}
+
+void svg_close_polygon(struct svg_writer *writer)
+{
+	svg_close_attr(writer);
+	svg_close_object(writer);
+}
+
+/*
+ * svg_write_path_minify - Closed path data as one absolute moveto followed
+ * by relative linetos.  The deltas are taken between the already rounded
+ * fixed point values so no rounding error accumulates along the path.
+ */
+
+static void svg_write_path_minify(struct svg_writer *writer,
+	const struct point_c *nodes, unsigned int count)
+{
+	const unsigned int precision = writer->precision;
+	long long last_x;
+	long long last_y;
+	unsigned int node;
+	char *start;
+	char *p;
+
+	last_x = format_to_fixed(nodes[0].x, precision);
+	last_y = format_to_fixed(nodes[0].y, precision);
+
+	if (last_x == LLONG_MIN || last_y == LLONG_MIN) {
+		goto absolute;
+	}
+	for (node = 1; node < count; node++) {
+		if (format_to_fixed(nodes[node].x, precision) == LLONG_MIN
+			|| format_to_fixed(nodes[node].y, precision) == LLONG_MIN) {
+			goto absolute;
+		}
+	}
+
+	start = p = svg_writer_reserve(writer, format_point_len(2));
+	*p++ = 'M';
+	p += format_fixed(p, last_x, precision);
+	*p++ = ',';
+	p += format_fixed(p, last_y, precision);
+	if (count > 1) {
+		*p++ = 'l';
+	}
+	svg_writer_commit(writer, p - start);
+
+	for (node = 1; node < count; node++) {
+		const long long x = format_to_fixed(nodes[node].x, precision);
+		const long long y = format_to_fixed(nodes[node].y, precision);
+
+		start = p = svg_writer_reserve(writer, format_point_len(1));
+		if (node > 1 && x - last_x >= 0) {
+			*p++ = ' ';
+		}
+		p += format_fixed(p, x - last_x, precision);
+		if (y - last_y >= 0) {
+			*p++ = ',';
+		}
+		p += format_fixed(p, y - last_y, precision);
+		svg_writer_commit(writer, p - start);
+
+		last_x = x;
+		last_y = y;
+	}
+	svg_writer_putc(writer, 'z');
+	return;
+
+absolute:
+	svg_writer_putc(writer, 'M');
+	svg_writer_put_points(writer, nodes, count, " ");
+	svg_writer_putc(writer, 'z');
+}
+
+void svg_write_path_nodes(struct svg_writer *writer,
+	const struct point_c *nodes, unsigned int count)
+{
+	assert(count);
+
+	if (writer->minify) {
+		svg_open_attr(writer, "d");
+		svg_write_path_minify(writer, nodes, count);
+		svg_close_attr(writer);
+		return;
+	}
+
+	svg_writer_puts(writer, "   d=\"M ");
+	svg_writer_put_points(writer, nodes, count, "\n    L ");
+	svg_writer_puts(writer, "\n    Z\"\n");
 }
 
-void svg_close_polygon(FILE *stream)
+/*
+ * svg_write_path_loops - Path data of loop_count closed loops, the nodes of
+ * each following those of the one before.  sizes holds their node counts.
+ */
+
+void svg_write_path_loops(struct svg_writer *writer,
+	const struct point_c *nodes, const unsigned int *sizes,
+	unsigned int loop_count)
 {
-	fprintf(stream, "\"\n");
-	svg_close_object(stream);
+	unsigned int loop;
+
+	assert(loop_count);
+
+	if (writer->minify) {
+		svg_open_attr(writer, "d");
+		for (loop = 0; loop < loop_count; loop++) {
+			svg_write_path_minify(writer, nodes, sizes[loop]);
+			nodes += sizes[loop];
+		}
+		svg_close_attr(writer);
+		return;
+	}
+
+	for (loop = 0; loop < loop_count; loop++) {
+		assert(sizes[loop]);
+		svg_writer_puts(writer, loop ? "\n    M " : "   d=\"M ");
+		svg_writer_put_points(writer, nodes, sizes[loop], "\n    L ");
+		svg_writer_puts(writer, "\n    Z");
+		nodes += sizes[loop];
+	}
+	svg_writer_puts(writer, "\"\n");
 }
 
-void svg_write_line(FILE *stream, const struct svg_style *style,
+void svg_write_line(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct svg_line *line)
 {
-	svg_open_object(stream, style, transform, id, "line");
+	svg_open_object(writer, style, transform, id, "line");
 //x1="0" y1="0" x2="200" y2="200"
-	fprintf(stream,
-		"x1=\"%f\" y1=\"%f\"\n  x2=\"%f\" y2=\"%f\"\n",
-		line->a.x, line->a.y, line->b.x, line->b.y);
+	svg_write_float_attr(writer, "x1", line->a.x, " ");
+	svg_write_float_attr(writer, "y1", line->a.y, "\n  ");
+	svg_write_float_attr(writer, "x2", line->b.x, " ");
+	svg_write_float_attr(writer, "y2", line->b.y, "\n");
 
-	svg_close_object(stream);
+	svg_close_object(writer);
 }
 
-void svg_write_rect(FILE *stream, const struct svg_style *style,
+void svg_write_rect(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct svg_rect *rect)
 {
-	svg_open_object(stream, style, transform, id, "rect");
+	svg_open_object(writer, style, transform, id, "rect");
 
-	fprintf(stream,
-		"width=\"%f\"\nheight=\"%f\"\nx=\"%f\"\ny=\"%f\"\nrx=\"%f\"\n",
-		rect->width, rect->height, rect->x, rect->y, rect->rx);
+	svg_write_float_attr(writer, "width", rect->width, "\n");
+	svg_write_float_attr(writer, "height", rect->height, "\n");
+	svg_write_float_attr(writer, "x", rect->x, "\n");
+	svg_write_float_attr(writer, "y", rect->y, "\n");
+	svg_write_float_attr(writer, "rx", rect->rx, "\n");
 
-	svg_close_object(stream);
+	svg_close_object(writer);
 }
 
-void svg_write_background(FILE *stream, const struct svg_style *style,
-	const struct svg_transform *transform,
+void svg_write_background(struct svg_writer *writer,
+	const struct svg_style *style, const struct svg_transform *transform,
 	const struct svg_rect *background_rect)
 {
 	assert(is_hex_color(style->fill.color));
 
-	svg_open_group(stream, style, transform, "background");
-	svg_write_rect(stream, style, transform, "background", background_rect);
-	svg_close_group(stream);
+	svg_open_group(writer, style, transform, "background");
+	svg_write_rect(writer, style, transform, "background", background_rect);
+	svg_close_group(writer);
 }
 
-void svg_write_star(FILE *stream, const struct svg_style *style,
+void svg_write_star(struct svg_writer *writer, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct star_params *star_params)
 {
-	struct node_buffer nb;
-	unsigned int node;
+	struct point_c nodes[2 * unit_star_points_max];
+	struct node_buffer nb = {0, NULL};
+	const struct point_c *p = nodes;
+	unsigned int count;
+
+	count = star_place(star_params, nodes);
+	if (!count) {
+		polygon_star_setup(star_params, &nb);
+		p = nb.nodes;
+		count = nb.node_count;
+	}
 
-	polygon_star_setup(star_params, &nb);
-	svg_open_polygon(stream, style, transform, id);
-	for (node = 0; node < nb.node_count; node++) {
+	svg_open_polygon(writer, style, transform, id);
+	svg_writer_put_points(writer, p, count, writer->minify ? " " : "\n");
+	svg_writer_eol(writer);
+	svg_close_polygon(writer);
 
-		fprintf(stream, "%f,%f\n", nb.nodes[node].x, nb.nodes[node].y);
-		//debug("node_%u: cart = {%f, %f}\n", node, nb.nodes[node].x,
-		//	nb.nodes[node].y);
+	if (nb.nodes) {
+		node_buffer_clean(&nb);
 	}
+}
+
+void svg_write_use(struct svg_writer *writer, const char *href, float x,
+	float y)
+{
+	svg_write_use_id(writer, NULL, href, x, y);
+}
+
+void svg_write_use_id(struct svg_writer *writer, const char *id,
+	const char *href, float x, float y)
+{
+	svg_write_use_object(writer, NULL, NULL, id, href, x, y);
+}
+
+/*
+ * svg_write_use_object - A <use> with its own style and transform.  The
+ * style is inherited by any referenced element that doesn't set its own.
+ */
+
+void svg_write_use_object(struct svg_writer *writer,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const char *href, float x, float y)
+{
+	svg_writer_puts(writer, "<use");
+	if (id) {
+		svg_writer_puts(writer, " id=\"");
+		svg_writer_puts(writer, id);
+		svg_writer_putc(writer, '"');
+	}
+	svg_writer_puts(writer, writer->minify ? " href=\"#"
+		: " xlink:href=\"#");
+	svg_writer_puts(writer, href);
+	svg_writer_putc(writer, '"');
+	if (style || transform) {
+		svg_writer_eol(writer);
+		svg_write_style(writer, style);
+		svg_write_transform(writer, transform);
+	}
+	if (x) {
+		svg_writer_puts(writer, " x=\"");
+		svg_writer_put_float(writer, x);
+		svg_writer_putc(writer, '"');
+	}
+	if (y) {
+		svg_writer_puts(writer, " y=\"");
+		svg_writer_put_float(writer, y);
+		svg_writer_putc(writer, '"');
+	}
+	svg_writer_puts(writer, "/>");
+	svg_writer_eol(writer);
+}
+
+/*
+ * FILE* stream shims.  Each call formats through a small stack buffer that
+ * is flushed to stream before returning.
+ */
+
+#define svg_stream_shim(_stream, _call) do { \
+	struct svg_writer _writer; \
+	char _buf[512]; \
+	svg_writer_init_buffer(&_writer, _stream, _buf, sizeof(_buf)); \
+	_call; \
+	svg_writer_flush(&_writer); \
+} while(0)
+
+void svg_stream_open_svg(FILE *stream, const struct svg_rect *background_rect)
+{
+	svg_stream_shim(stream, svg_open_svg(&_writer, background_rect));
+}
+
+void svg_stream_close_svg(FILE *stream)
+{
+	svg_stream_shim(stream, svg_close_svg(&_writer));
+}
 
-	svg_close_polygon(stream);
-	node_buffer_clean(&nb);
+void svg_stream_write_comment(FILE *stream, const char *text)
+{
+	svg_stream_shim(stream, svg_write_comment(&_writer, text));
+}
+
+void svg_stream_open_group(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id)
+{
+	svg_stream_shim(stream, svg_open_group(&_writer, style, transform, id));
+}
+
+void svg_stream_close_group(FILE *stream)
+{
+	svg_stream_shim(stream, svg_close_group(&_writer));
+}
+
+void svg_stream_open_object(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id, const char *type)
+{
+	svg_stream_shim(stream, svg_open_object(&_writer, style, transform,
+		id, type));
+}
+
+void svg_stream_close_object(FILE *stream)
+{
+	svg_stream_shim(stream, svg_close_object(&_writer));
+}
+
+void svg_stream_open_path(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id)
+{
+	svg_stream_shim(stream, svg_open_path(&_writer, style, transform, id));
+}
+
+void svg_stream_open_polygon(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id)
+{
+	svg_stream_shim(stream, svg_open_polygon(&_writer, style, transform,
+		id));
+}
+
+void svg_stream_close_polygon(FILE *stream)
+{
+	svg_stream_shim(stream, svg_close_polygon(&_writer));
+}
+
+void svg_stream_write_line(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct svg_line *line)
+{
+	svg_stream_shim(stream, svg_write_line(&_writer, style, transform, id,
+		line));
+}
+
+void svg_stream_write_rect(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct svg_rect *rect)
+{
+	svg_stream_shim(stream, svg_write_rect(&_writer, style, transform, id,
+		rect));
+}
+
+void svg_stream_write_background(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform,
+	const struct svg_rect *background_rect)
+{
+	svg_stream_shim(stream, svg_write_background(&_writer, style,
+		transform, background_rect));
+}
+
+void svg_stream_write_star(FILE *stream, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct star_params *star_params)
+{
+	svg_stream_shim(stream, svg_write_star(&_writer, style, transform, id,
+		star_params));
+}
+
+void svg_stream_write_use(FILE *stream, const char *href, float x, float y)
+{
+	svg_stream_shim(stream, svg_write_use(&_writer, href, x, y));
 }
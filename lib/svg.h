@@ -9,6 +9,7 @@
 
 #include "color.h"
 #include "geometry.h"
+#include "svg-writer.h"
 
 struct svg_fill {
 	char color[hex_color_len];
@@ -22,6 +23,7 @@ struct svg_stroke {
 struct svg_style {
 	struct svg_fill fill;
 	struct svg_stroke stroke;
+	unsigned int style_class;	// 1 + class number, 0 for attributes.
 };
 
 struct svg_transform {
@@ -98,8 +100,8 @@ static const struct svg_style svg_style_white_white = {
 	.stroke.width = 1,
 };
 
-FILE *svg_debug_stream(void);
-void svg_debug_stream_set(FILE *stream);
+struct svg_writer *svg_debug_writer(void);
+void svg_debug_writer_set(struct svg_writer *writer);
 
 struct svg_fill *svg_fill_set(struct svg_fill *fill, const char *color);
 struct svg_stroke *svg_stroke_set(struct svg_stroke *stroke, const char *color,
@@ -109,40 +111,101 @@ static inline struct svg_style *svg_style_set(struct svg_style *style, const cha
 {
 	svg_fill_set(&style->fill, fill_color);
 	svg_stroke_set(&style->stroke, stroke_color, stroke_width);
+	style->style_class = 0;
 	return style;
 }
 
-void svg_open_svg(FILE *stream, const struct svg_rect *background_rect);
-void svg_close_svg(FILE *stream);
+void svg_open_attr(struct svg_writer *writer, const char *name);
+void svg_close_attr(struct svg_writer *writer);
 
-void svg_write_comment(FILE *stream, const char *text);
+void svg_write_style_rule(struct svg_writer *writer,
+	const struct svg_style *style, unsigned int style_class);
+void svg_open_defs(struct svg_writer *writer);
+void svg_close_defs(struct svg_writer *writer);
+void svg_open_style_sheet(struct svg_writer *writer);
+void svg_close_style_sheet(struct svg_writer *writer);
 
-void svg_open_group(FILE *stream, const struct svg_style *style,
+void svg_open_svg(struct svg_writer *writer,
+	const struct svg_rect *background_rect);
+void svg_close_svg(struct svg_writer *writer);
+
+void svg_write_comment(struct svg_writer *writer, const char *text);
+
+void svg_open_group(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id);
+void svg_close_group(struct svg_writer *writer);
+
+void svg_open_object(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id, const char *type);
+void svg_close_object(struct svg_writer *writer);
+
+void svg_open_path(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id);
+
+void svg_open_polygon(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id);
+void svg_close_polygon(struct svg_writer *writer);
+
+void svg_write_path_nodes(struct svg_writer *writer,
+	const struct point_c *nodes, unsigned int count);
+void svg_write_path_loops(struct svg_writer *writer,
+	const struct point_c *nodes, const unsigned int *sizes,
+	unsigned int loop_count);
+
+void svg_write_line(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct svg_line *line);
+void svg_write_rect(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct svg_rect *rect);
+void svg_write_background(struct svg_writer *writer,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const struct svg_rect *background_rect);
+void svg_write_star(struct svg_writer *writer, const struct svg_style *style,
+	const struct svg_transform *transform, const char *id,
+	const struct star_params *star_params);
+void svg_write_use(struct svg_writer *writer, const char *href, float x,
+	float y);
+void svg_write_use_id(struct svg_writer *writer, const char *id,
+	const char *href, float x, float y);
+void svg_write_use_object(struct svg_writer *writer,
+	const struct svg_style *style, const struct svg_transform *transform,
+	const char *id, const char *href, float x, float y);
+
+/* FILE* stream shims. */
+
+void svg_stream_open_svg(FILE *stream, const struct svg_rect *background_rect);
+void svg_stream_close_svg(FILE *stream);
+
+void svg_stream_write_comment(FILE *stream, const char *text);
+
+void svg_stream_open_group(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id);
-void svg_close_group(FILE *stream);
+void svg_stream_close_group(FILE *stream);
 
-void svg_open_object(FILE *stream, const struct svg_style *style,
+void svg_stream_open_object(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id, const char *type);
-void svg_close_object(FILE *stream);
+void svg_stream_close_object(FILE *stream);
 
-void svg_open_path(FILE *stream, const struct svg_style *style,
+void svg_stream_open_path(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id);
 
-void svg_open_polygon(FILE *stream, const struct svg_style *style,
+void svg_stream_open_polygon(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id);
-void svg_close_polygon(FILE *stream);
+void svg_stream_close_polygon(FILE *stream);
 
-void svg_write_line(FILE *stream, const struct svg_style *style,
+void svg_stream_write_line(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct svg_line *line);
-void svg_write_rect(FILE *stream, const struct svg_style *style,
+void svg_stream_write_rect(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct svg_rect *rect);
-void svg_write_background(FILE *stream, const struct svg_style *style,
+void svg_stream_write_background(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform,
 	const struct svg_rect *background_rect);
-void svg_write_star(FILE *stream, const struct svg_style *style,
+void svg_stream_write_star(FILE *stream, const struct svg_style *style,
 	const struct svg_transform *transform, const char *id,
 	const struct star_params *star_params);
+void svg_stream_write_use(FILE *stream, const char *href, float x, float y);
 
 #endif /* _MD_GENERATOR_SVG_H */
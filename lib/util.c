@@ -127,68 +127,48 @@ int to_signed(const char *str)
 	return (int)l;
 }
 
-unsigned int to_unsigned(const char *str)
+/*
+ * to_unsigned_checked - Parse the full unsigned int range into value.
+ * Returns zero on success, or -1 after reporting why str was rejected.
+ */
+
+int to_unsigned_checked(const char *str, unsigned int *value)
 {
 	const char *p;
 	unsigned long u;
 
+	if (!*str) {
+		error("empty value\n");
+		return -1;
+	}
+
 	for (p = str; *p; p++) {
 		if (!isdigit(*p)) {
 			error("isdigit failed: '%s'\n", str);
-			return UINT_MAX;
+			return -1;
 		}
 	}
 
+	errno = 0;
 	u = strtoul(str, NULL, 10);
 
-	if (u == ULONG_MAX) {
+	if (errno) {
 		error("strtoul '%s' failed: %s\n", str, strerror(errno));
-		return UINT_MAX;
+		return -1;
 	}
 
 	if (u > UINT_MAX) {
 		error("too big: %lu\n", u);
-		return UINT_MAX;
+		return -1;
 	}
 
-	return (unsigned int)u;
-}
-
-int random_int(int min, int max)
-{
-	return min + (rand() % (max - min + 1));
-}
-
-unsigned int random_unsigned(unsigned int min, unsigned int max)
-{
-	return (unsigned int)(min + (rand() % (max - min + 1)));
+	*value = (unsigned int)u;
+	return 0;
 }
 
-float random_float(float min, float max)
-{
-    return min + (float)rand() / (float)RAND_MAX * (max - min);
-}
-
-unsigned int *random_array(unsigned int len)
+unsigned int to_unsigned(const char *str)
 {
-	unsigned int *p;
-	unsigned int i;
-
-	p = mem_alloc(len * sizeof(*p));
+	unsigned int u;
 
-	for (i = 0; i < len; i++) {
-		p[i] = i;
-	}
-
-	for (i = 0; i < len; i++) {
-		unsigned int j;
-		unsigned int tmp;
-
-		j = rand() % len;
-		tmp = p[i];
-		p[i] = p[j];
-		p[j] = tmp;
-	}
-
-	return p;
+	return to_unsigned_checked(str, &u) ? UINT_MAX : u;
 }
@@ -11,13 +11,9 @@ const char *eat_front_ws(const char *p);
 void eat_tail_ws(char *p);
 
 unsigned int to_unsigned(const char *str);
+int to_unsigned_checked(const char *str, unsigned int *value);
 float to_float(const char *str);
 
-int random_int(int min, int max);
-unsigned int random_unsigned(unsigned int min, unsigned int max);
-float random_float(float min, float max);
-unsigned int *random_array(unsigned int len);
-
 static inline float min_f(float a, float b)
 {
 	return a < b ? a : b;
@@ -0,0 +1,47 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+
+#include "log.h"
+#include "mem.h"
+#include "vector.h"
+
+enum {vector_min_size = 16U};
+
+/*
+ * vector_grow - Make room for need entries of elem bytes in the table items
+ * of size entries, doubling the size until they fit.  Returns the (new)
+ * table.
+ */
+
+void *_vector_grow(void *items, unsigned int *size, unsigned int need,
+	size_t elem, const char *func, int line)
+{
+	unsigned int new_size = *size ? *size : vector_min_size;
+
+	if (need <= *size) {
+		return items;
+	}
+
+	while (new_size < need) {
+		if (new_size > UINT_MAX / 2) {
+			error("Vector too big: %u.\n", need);
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+		new_size *= 2;
+	}
+
+	*size = new_size;
+	return _mem_realloc(items, (size_t)new_size * elem, func, line);
+}
@@ -0,0 +1,51 @@
+/*
+ *  moto-design SGV utils.
+ */
+
+#if ! defined(_MD_GENERATOR_VECTOR_H)
+#define _MD_GENERATOR_VECTOR_H
+
+#include <stdlib.h>
+
+#include "mem.h"
+
+/*
+ * A vector is a growable array of one type, declared with VECTOR(type).
+ * Zero one to init it.  Room grows geometrically, so vector_push() and
+ * vector_add() are amortized O(1).  New entries are zeroed.
+ */
+
+#define VECTOR(type) struct {	\
+	type *items;		\
+	unsigned int count;	\
+	unsigned int size;	\
+}
+
+void *_vector_grow(void *items, unsigned int *size, unsigned int need,
+	size_t elem, const char *func, int line);
+
+/* vector_grow - The memory census counts the growth at the caller. */
+#define vector_grow(_items, _size, _need, _elem)			\
+	_vector_grow(_items, _size, _need, _elem, __func__, __LINE__)
+
+/* vector_reserve - Make room for need items in all. */
+#define vector_reserve(v, need)						\
+	((v)->items = vector_grow((v)->items, &(v)->size, (need),	\
+		sizeof(*(v)->items)))
+
+/* vector_add - Append a zeroed item and return a pointer to it. */
+#define vector_add(v)							\
+	(vector_reserve((v), (v)->count + 1), &(v)->items[(v)->count++])
+
+#define vector_push(v, item) (*vector_add(v) = (item))
+
+#define vector_clean(v) do {						\
+	if ((v)->items) {						\
+		mem_free((v)->items);					\
+	}								\
+	(v)->items = NULL;						\
+	(v)->count = 0;							\
+	(v)->size = 0;							\
+} while (0)
+
+#endif /* _MD_GENERATOR_VECTOR_H */
@@ -0,0 +1,382 @@
+/*
+ *  moto-design memory benchmark.
+ */
+
+/*
+  Build it with 'make mem-bench' in trees configured with
+  --enable-fast-alloc and --disable-fast-alloc, and compare the runs.
+*/
+
+#define _GNU_SOURCE
+#define _ISOC99_SOURCE
+
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "svg-utils.h"
+
+static const char program_name[] = "mem-bench";
+
+static void print_version(void)
+{
+	printf("%s (" PACKAGE_NAME ") " PACKAGE_VERSION "\n", program_name);
+}
+
+static void print_bugreport(void)
+{
+	fprintf(stderr, "Report bugs at " PACKAGE_BUGREPORT ".\n");
+}
+
+enum opt_value {opt_undef = 0, opt_yes, opt_no};
+
+struct opts {
+	unsigned int iterations;
+	unsigned int threads;
+	enum opt_value help;
+	enum opt_value verbose;
+	enum opt_value version;
+};
+
+static void print_usage(const struct opts *opts)
+{
+	print_version();
+
+	fprintf(stderr,
+"%s - Times the allocator on generator-like workloads.\n"
+"Usage: %s [flags]\n"
+"Option flags:\n"
+"  --iterations      - Operations per test per thread. Default: '%u'.\n"
+"  --threads         - Threads running each test at once. Default: '%u'.\n"
+"  -h --help         - Show this help and exit.\n"
+"  -v --verbose      - Verbose execution.\n"
+"  -V --version      - Display the program version number.\n",
+		program_name, program_name,
+		opts->iterations,
+		opts->threads
+	);
+
+	print_bugreport();
+}
+
+static int opts_parse(struct opts *opts, int argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{"iterations",  required_argument, NULL, 'i'},
+		{"threads",     required_argument, NULL, 'T'},
+		{"help",        no_argument,       NULL, 'h'},
+		{"verbose",     no_argument,       NULL, 'v'},
+		{"version",     no_argument,       NULL, 'V'},
+		{ NULL,         0,                 NULL, 0},
+	};
+	static const char short_options[] = "hvV";
+
+	*opts = (struct opts){
+		.iterations = 2000000U,
+		.threads = 1,
+		.help = opt_no,
+		.verbose = opt_no,
+		.version = opt_no,
+	};
+
+	while (1) {
+		int c = getopt_long(argc, argv, short_options, long_options,
+			NULL);
+
+		if (c == EOF)
+			break;
+
+		switch (c) {
+		case 'i':
+			opts->iterations = to_unsigned(optarg);
+			if (opts->iterations == UINT_MAX || !opts->iterations) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'T':
+			opts->threads = to_unsigned(optarg);
+			if (opts->threads == UINT_MAX || !opts->threads) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'h':
+			opts->help = opt_yes;
+			break;
+		case 'v':
+			opts->verbose = opt_yes;
+			break;
+		case 'V':
+			opts->version = opt_yes;
+			break;
+		default:
+			assert(0);
+			opts->help = opt_yes;
+			return -1;
+		}
+	}
+
+	return optind != argc;
+}
+
+/*
+ * Each test keeps ring_size blocks live and replaces the oldest one per
+ * operation, with sizes drawn from what the generators ask for: node
+ * buffers, ids and style strings of 8 to 512 bytes.
+ */
+
+enum {
+	ring_size = 256U,
+	size_min = 8U,
+	size_max = 512U,
+};
+
+static unsigned int bench_size(unsigned int *state)
+{
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return size_min + x % (size_max - size_min + 1);
+}
+
+static void touch(char *p, unsigned int size)
+{
+	p[0] = 1;
+	p[size - 1] = 1;
+}
+
+static void test_alloc(unsigned int iterations, unsigned int seed)
+{
+	char *ring[ring_size] = {NULL};
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		const unsigned int size = bench_size(&seed);
+		char **slot = &ring[i % ring_size];
+
+		if (*slot) {
+			mem_free(*slot);
+		}
+		*slot = mem_alloc(size);
+		touch(*slot, size);
+	}
+	for (i = 0; i < ring_size; i++) {
+		if (ring[i]) {
+			mem_free(ring[i]);
+		}
+	}
+}
+
+static void test_alloc_uninit(unsigned int iterations, unsigned int seed)
+{
+	char *ring[ring_size] = {NULL};
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		const unsigned int size = bench_size(&seed);
+		char **slot = &ring[i % ring_size];
+
+		if (*slot) {
+			mem_free(*slot);
+		}
+		*slot = mem_alloc_uninit(size);
+		touch(*slot, size);
+	}
+	for (i = 0; i < ring_size; i++) {
+		if (ring[i]) {
+			mem_free(ring[i]);
+		}
+	}
+}
+
+static void test_malloc(unsigned int iterations, unsigned int seed)
+{
+	char *ring[ring_size] = {NULL};
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		const unsigned int size = bench_size(&seed);
+		char **slot = &ring[i % ring_size];
+
+		free(*slot);
+		*slot = malloc(size);
+		if (!*slot) {
+			error("Malloc %u failed.\n", size);
+			exit(EXIT_FAILURE);
+		}
+		touch(*slot, size);
+	}
+	for (i = 0; i < ring_size; i++) {
+		free(ring[i]);
+	}
+}
+
+static void test_arena(unsigned int iterations, unsigned int seed)
+{
+	struct mem_arena arena;
+	unsigned int i;
+
+	mem_arena_init(&arena, 0);
+
+	for (i = 0; i < iterations; i++) {
+		const unsigned int size = bench_size(&seed);
+
+		if (i % ring_size == ring_size - 1) {
+			mem_arena_reset(&arena);
+		}
+		touch(mem_arena_alloc(&arena, size), size);
+	}
+	mem_arena_clean(&arena);
+}
+
+// A path of up to size_max points, built and dropped.
+static void test_vector(unsigned int iterations, unsigned int seed)
+{
+	VECTOR(struct point_c) nodes = {NULL, 0, 0};
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		const struct point_c p = {(float)i, (float)seed};
+
+		if (nodes.count == size_max) {
+			vector_clean(&nodes);
+		}
+		vector_push(&nodes, p);
+	}
+	vector_clean(&nodes);
+}
+
+struct bench_test {
+	const char *name;
+	void (*run)(unsigned int iterations, unsigned int seed);
+};
+
+static const struct bench_test tests[] = {
+	{"mem_alloc", test_alloc},
+	{"mem_alloc_uninit", test_alloc_uninit},
+	{"malloc", test_malloc},
+	{"mem_arena_alloc", test_arena},
+	{"vector_push", test_vector},
+};
+
+struct bench_job {
+	const struct bench_test *test;
+	unsigned int iterations;
+	unsigned int seed;
+};
+
+static void *bench_job_run(void *arg)
+{
+	struct bench_job *job = arg;
+
+	job->test->run(job->iterations, job->seed);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * run_test - Wall time of thread_count threads each running the test,
+ * in nanoseconds per operation of one thread.
+ */
+
+static double run_test(const struct bench_test *test,
+	unsigned int iterations, unsigned int thread_count)
+{
+	struct bench_job *jobs;
+	pthread_t *threads;
+	double start;
+	unsigned int t;
+
+	jobs = mem_alloc(thread_count * sizeof(*jobs));
+	threads = mem_alloc(thread_count * sizeof(*threads));
+
+	start = now();
+
+	for (t = 0; t < thread_count; t++) {
+		int result;
+
+		jobs[t].test = test;
+		jobs[t].iterations = iterations;
+		jobs[t].seed = 2463534242U + t;
+
+		result = pthread_create(&threads[t], NULL, bench_job_run,
+			&jobs[t]);
+		if (result) {
+			error("pthread_create failed: %s\n", strerror(result));
+			assert(0);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (t = 0; t < thread_count; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	start = (now() - start) * 1e9 / iterations;
+
+	mem_free(threads);
+	mem_free(jobs);
+
+	return start;
+}
+
+int main(int argc, char *argv[])
+{
+	struct opts opts;
+	unsigned int i;
+
+	log_set_exit_on_error(true);
+
+	if (opts_parse(&opts, argc, argv)) {
+		print_usage(&opts);
+		return EXIT_FAILURE;
+	}
+
+	if (opts.version == opt_yes) {
+		print_version();
+		return EXIT_SUCCESS;
+	}
+
+	if (opts.verbose == opt_yes) {
+		log_set_verbose(true);
+	}
+
+	if (opts.help == opt_yes) {
+		print_usage(&opts);
+		return EXIT_SUCCESS;
+	}
+
+#if defined(MEM_FAST_ALLOC)
+	printf("allocator: fast\n");
+#else
+	printf("allocator: guarded\n");
+#endif
+	printf("%u iterations, %u threads\n", opts.iterations, opts.threads);
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("  %-18s %8.1f ns/op\n", tests[i].name,
+			run_test(&tests[i], opts.iterations, opts.threads));
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -40,6 +40,12 @@ enum opt_value {opt_undef = 0, opt_yes, opt_no};
 struct opts {
 	struct star_params star_params;
 	char *output_file;
+	unsigned int seed;
+	enum opt_value seed_set;
+	unsigned int precision;
+	enum opt_value minify;
+	int compress;
+	enum opt_value mem_stats;
 	enum opt_value help;
 	enum opt_value verbose;
 	enum opt_value version;
@@ -71,7 +77,13 @@ static void print_usage(const struct opts *opts)
 "  --density         - Polygon density. Default: '%u'.\n"
 "  --radius          - Radius. Default: '%f'.\n"
 "  --rotation        - Rotation. Default: '%f'.\n"
+"  --seed            - Random seed. Default: the current time.\n"
+"  --precision       - Output coordinate decimal places. Default: '%u'.\n"
+"  --minify          - Minify output. Default: '%s'.\n"
+"  --compress[=L]    - Gzip output at level L, implied by a .svgz\n"
+"                      output file.  Default L: '%d'.\n"
 "  -o --output-file  - Output file. Default: '%s'.\n"
+"  --mem-stats       - Print a memory census at exit. Default: '%s'.\n"
 "  -h --help         - Show this help and exit.\n"
 "  -v --verbose      - Verbose execution.\n"
 "  -V --version      - Display the program version number.\n",
@@ -80,7 +92,11 @@ static void print_usage(const struct opts *opts)
 		opts->star_params.density,
 		opts->star_params.radius,
 		opts->star_params.rotation,
-		opts->output_file
+		opts->precision,
+		(opts->minify == opt_yes ? "yes" : "no"),
+		svg_writer_compress_default,
+		opts->output_file,
+		(opts->mem_stats == opt_yes ? "yes" : "no")
 	);
 
 	print_bugreport();
@@ -94,9 +110,14 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		{"radius",       required_argument, NULL, '3'},
 		{"rotation",     required_argument, NULL, '4'},
 
+		{"seed",           required_argument, NULL, 'S'},
+		{"precision",      required_argument, NULL, 'P'},
+		{"minify",         no_argument,       NULL, 'm'},
+		{"compress",       optional_argument, NULL, 'z'},
 		{"output-file",    required_argument, NULL, 'o'},
 		{"config-file",    required_argument, NULL, 'f'},
 		{"background",     no_argument,       NULL, 'b'},
+		{"mem-stats",      no_argument,       NULL, 'X'},
 		{"help",           no_argument,       NULL, 'h'},
 		{"verbose",        no_argument,       NULL, 'v'},
 		{"version",        no_argument,       NULL, 'V'},
@@ -107,6 +128,12 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 	*opts = (struct opts){
 		.star_params = init_star_params,
 		.output_file = "-",
+		.seed = 0,
+		.seed_set = opt_no,
+		.precision = format_precision_default,
+		.minify = opt_no,
+		.compress = svg_writer_compress_off,
+		.mem_stats = opt_no,
 		.help = opt_no,
 		.verbose = opt_no,
 		.version = opt_no,
@@ -163,6 +190,36 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 				return -1;
 			}
 			break;
+		case 'S':
+			if (to_unsigned_checked(optarg, &opts->seed)) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			opts->seed_set = opt_yes;
+			break;
+		case 'P':
+			opts->precision = to_unsigned(optarg);
+			if (opts->precision == UINT_MAX ||
+				opts->precision > format_precision_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'm':
+			opts->minify = opt_yes;
+			break;
+		case 'z':
+			if (!optarg) {
+				opts->compress = svg_writer_compress_default;
+				break;
+			}
+			opts->compress = (int)to_unsigned(optarg);
+			if (opts->compress < 0 ||
+				opts->compress > svg_writer_compress_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
 		// admin
 		case 'o': {
 			size_t len;
@@ -180,6 +237,9 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 			strcpy(opts->output_file, optarg);
 			break;
 		}
+		case 'X':
+			opts->mem_stats = opt_yes;
+			break;
 		case 'h':
 			opts->help = opt_yes;
 			break;
@@ -199,9 +259,11 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 	return optind != argc;
 }
 
-static void write_svg(FILE* out_stream, const struct star_params *star_params)
+static void write_svg(struct svg_writer *writer,
+	const struct star_params *star_params)
 {
 	struct svg_rect background_rect;
+	struct svg_scene scene;
 	char star_id[256];
 
 	snprintf(star_id, sizeof(star_id), "star_%d_%d", star_params->points,
@@ -217,11 +279,16 @@ static void write_svg(FILE* out_stream, const struct star_params *star_params)
 	//background_rect.x = 0.0;
 	//background_rect.y = -background_rect.height;
 
-	svg_open_svg(out_stream, &background_rect);
-	//svg_debug_stream_set(out_stream);
-	svg_write_star(out_stream, &svg_style_yellow_blue, NULL, star_id,
+	svg_scene_init(&scene);
+	svg_scene_add_star(&scene, &svg_style_yellow_blue, NULL, star_id,
 		star_params);
-	svg_close_svg(out_stream);
+
+	svg_open_svg(writer, &background_rect);
+	//svg_debug_writer_set(writer);
+	svg_scene_write(writer, &scene);
+	svg_close_svg(writer);
+
+	svg_scene_clean(&scene);
 }
 
 
@@ -229,6 +296,7 @@ int main(int argc, char *argv[])
 {
 	struct opts opts;
 	FILE *out_stream;
+	struct svg_writer writer;
 
 	log_set_exit_on_error(true);
 
@@ -276,9 +344,29 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
-	srand((unsigned int)time(NULL));
+	if (opts.mem_stats == opt_yes) {
+		mem_census_start();
+	}
+
+	if (opts.seed_set != opt_yes) {
+		opts.seed = (unsigned int)time(NULL);
+	}
+	log("seed = %u\n", opts.seed);
+	random_seed(opts.seed);
 
-	write_svg(out_stream, &opts.star_params);
+	svg_writer_init(&writer, out_stream, 0);
+	svg_writer_set_precision(&writer, opts.precision);
+	svg_writer_set_minify(&writer, opts.minify == opt_yes);
+
+	if (opts.compress == svg_writer_compress_off &&
+		svg_writer_is_svgz(opts.output_file)) {
+		opts.compress = svg_writer_compress_default;
+	}
+	if (opts.compress != svg_writer_compress_off) {
+		svg_writer_compress(&writer, opts.compress);
+	}
+	write_svg(&writer, &opts.star_params);
+	svg_writer_clean(&writer);
 
 	return EXIT_SUCCESS;
 }
@@ -60,8 +60,15 @@ enum opt_value {opt_undef = 0, opt_yes, opt_no};
 struct opts {
 	struct stripe_params stripe_params;
 	char *output_file;
+	unsigned int seed;
+	enum opt_value seed_set;
+	unsigned int precision;
+	enum opt_value minify;
+	int compress;
 	char *config_file;
 	enum opt_value background;
+	enum opt_value clip;
+	enum opt_value mem_stats;
 	enum opt_value help;
 	enum opt_value verbose;
 	enum opt_value version;
@@ -139,9 +146,17 @@ static void print_usage(const struct opts *opts)
 "  --third-edge-start  - edge width. Default: '%f'.\n"
 "  --third-edge-end    - edge width. Default: '%f'.\n"
 
+"  --seed             - Random seed. Default: the current time.\n"
+"  --precision        - Output coordinate decimal places. Default: '%u'.\n"
+"  --minify           - Minify output. Default: '%s'.\n"
+"  --compress[=L]     - Gzip output at level L, implied by a .svgz\n"
+"                       output file.  Default L: '%d'.\n"
 "  -o --output-file   - Output file. Default: '%s'.\n"
 "  -f --config-file   - Config file. Default: '%s'.\n"
 "  -b --background    - Generate image background. Default: '%s'.\n"
+"  --clip             - Clip blocks to the view box and drop the ones\n"
+"                       outside it. Default: '%s'.\n"
+"  --mem-stats        - Print a memory census at exit. Default: '%s'.\n"
 "  -h --help          - Show this help and exit.\n"
 "  -v --verbose       - Verbose execution.\n"
 "  -V --version       - Display the program version number.\n",
@@ -163,9 +178,14 @@ static void print_usage(const struct opts *opts)
 		opts->stripe_params.third_edge.start,
 		opts->stripe_params.third_edge.end,
 
+		opts->precision,
+		(opts->minify == opt_yes ? "yes" : "no"),
+		svg_writer_compress_default,
 		opts->output_file,
 		opts->config_file,
-		(opts->background ? "yes" : "no")
+		(opts->background ? "yes" : "no"),
+		(opts->clip == opt_yes ? "yes" : "no"),
+		(opts->mem_stats == opt_yes ? "yes" : "no")
 	);
 
 	print_bugreport();
@@ -191,9 +211,15 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		{"third-edge-start",  required_argument, NULL, 'N'},
 		{"third-edge-end",    required_argument, NULL, 'O'},
 
+		{"seed",           required_argument, NULL, 'S'},
+		{"precision",      required_argument, NULL, 'P'},
+		{"minify",         no_argument,       NULL, 'm'},
+		{"compress",       optional_argument, NULL, 'z'},
 		{"output-file",    required_argument, NULL, 'o'},
 		{"config-file",    required_argument, NULL, 'f'},
 		{"background",     no_argument,       NULL, 'b'},
+		{"clip",           no_argument,       NULL, 'x'},
+		{"mem-stats",      no_argument,       NULL, 'X'},
 		{"help",           no_argument,       NULL, 'h'},
 		{"verbose",        no_argument,       NULL, 'v'},
 		{"version",        no_argument,       NULL, 'V'},
@@ -204,8 +230,15 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 	*opts = (struct opts){
 		.stripe_params = init_stripe_params,
 		.output_file = "-",
+		.seed = 0,
+		.seed_set = opt_no,
+		.precision = format_precision_default,
+		.minify = opt_no,
+		.compress = svg_writer_compress_off,
 		.config_file = NULL,
 		.background = opt_no,
+		.clip = opt_no,
+		.mem_stats = opt_no,
 		.help = opt_no,
 		.verbose = opt_no,
 		.version = opt_no,
@@ -284,6 +317,39 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 		case 'b':
 			opts->background = opt_yes;
 			break;
+		case 'x':
+			opts->clip = opt_yes;
+			break;
+		case 'S':
+			if (to_unsigned_checked(optarg, &opts->seed)) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			opts->seed_set = opt_yes;
+			break;
+		case 'P':
+			opts->precision = to_unsigned(optarg);
+			if (opts->precision == UINT_MAX ||
+				opts->precision > format_precision_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
+		case 'm':
+			opts->minify = opt_yes;
+			break;
+		case 'z':
+			if (!optarg) {
+				opts->compress = svg_writer_compress_default;
+				break;
+			}
+			opts->compress = (int)to_unsigned(optarg);
+			if (opts->compress < 0 ||
+				opts->compress > svg_writer_compress_max) {
+				opts->help = opt_yes;
+				return -1;
+			}
+			break;
 		// admin
 		case 'o': {
 			size_t len;
@@ -317,6 +383,9 @@ static int opts_parse(struct opts *opts, int argc, char *argv[])
 			strcpy(opts->config_file, optarg);
 			break;
 		}
+		case 'X':
+			opts->mem_stats = opt_yes;
+			break;
 		case 'h':
 			opts->help = opt_yes;
 			break;
@@ -374,21 +443,55 @@ static struct stripe_factors get_stripe_factors(const struct stripe_params *sp)
 	return sf;
 }
 
-static void write_block(FILE* out_stream, const struct block_params *block)
+/* Clipping of blocks to the view box, rect NULL for none. */
+
+struct block_clip {
+	const struct svg_rect *rect;
+	struct clip_buffer cb;
+	unsigned int clipped;
+	unsigned int dropped;
+};
+
+static void write_block(struct svg_scene *scene,
+	const struct block_params *block, struct block_clip *clip)
 {
+	const struct point_c corners[] = {
+		block->bottom_left,
+		block->top_left,
+		block->top_right,
+		block->bottom_right,
+	};
+	const struct point_c *nodes = corners;
+	unsigned int node_count = sizeof(corners) / sizeof(corners[0]);
+
 	debug("%s\n", block->id);
 	debug(" BL %f,%f\n", block->bottom_left.x, block->bottom_left.y);
 	debug(" BR %f,%f\n", block->bottom_right.x, block->bottom_right.y);
 	debug(" TL %f,%f\n", block->top_left.x, block->top_left.y);
 	debug(" TR %f,%f\n", block->top_right.x, block->top_right.y);
 
-	svg_open_path(out_stream, &block->style, NULL, block->id);
-	fprintf(out_stream, "   d=\"M %f,%f\n", block->bottom_left.x, block->bottom_left.y);
-	fprintf(out_stream, "    L %f,%f\n", block->top_left.x, block->top_left.y);
-	fprintf(out_stream, "    L %f,%f\n", block->top_right.x, block->top_right.y);
-	fprintf(out_stream, "    L %f,%f\n", block->bottom_right.x, block->bottom_right.y);
-	fprintf(out_stream, "    Z\"\n");
-	svg_close_object(out_stream);
+	// The stripe rect can have a negative height, clip to its span.
+	if (clip->rect) {
+		const struct svg_rect *r = clip->rect;
+
+		node_count = polygon_clip_box(corners, node_count,
+			min_f(r->x, r->x + r->width),
+			min_f(r->y, r->y + r->height),
+			max_f(r->x, r->x + r->width),
+			max_f(r->y, r->y + r->height), &clip->cb, &nodes);
+
+		if (!node_count) {
+			debug("%s: outside\n", block->id);
+			clip->dropped++;
+			return;
+		}
+		if (nodes != corners) {
+			clip->clipped++;
+		}
+	}
+
+	svg_scene_add_path(scene, &block->style, NULL, block->id, NULL,
+		nodes, node_count);
 }
 
 static struct point_c next_point(const struct point_c* start,
@@ -412,7 +515,7 @@ struct start_points {
 
 static struct block_params* fill_block_array(
 	const struct stripe_params *stripe_params,
-	const struct start_points *start)
+	const struct start_points *start, struct mem_arena *arena)
 {
 	unsigned int i;
 	float gap_width;
@@ -424,7 +527,8 @@ static struct block_params* fill_block_array(
 	block_width = stripe_params->block_width;
 	gap_width = stripe_params->gap_width;
 
-	block_array = mem_alloc((stripe_params->block_count + 1) * sizeof(block_array[0]));
+	block_array = mem_arena_alloc(arena,
+		(stripe_params->block_count + 1) * sizeof(block_array[0]));
 	block_array[0].bottom_right = start->bottom;
 	block_array[0].top_right = start->top;
 
@@ -476,8 +580,8 @@ static struct edges get_edges(const struct stripe_params *stripe_params,
 	return edges;
 }
 
-static void write_svg(FILE* out_stream,
-	const struct stripe_params *stripe_params, bool background)
+static void write_svg(struct svg_writer *writer,
+	const struct stripe_params *stripe_params, bool background, bool clip)
 {
 	const float tan_top = tanf(deg_to_rad(stripe_params->top_angle));
 	const float tan_bottom = tanf(deg_to_rad(stripe_params->bottom_angle));
@@ -488,6 +592,9 @@ static void write_svg(FILE* out_stream,
 	struct start_points start;
 	struct block_params* block_array;
 	struct edges edges;
+	struct svg_scene scene;
+	struct block_clip block_clip = {.rect = NULL};
+	struct mem_arena arena;
 
 	(void)tan_bottom;
 
@@ -503,7 +610,8 @@ static void write_svg(FILE* out_stream,
 	debug("start.bottom = (%f,%f)\n", start.bottom.x, start.bottom.y);
 	debug("start.top = (%f,%f)\n", start.top.x, start.top.y);
 
-	block_array = fill_block_array(stripe_params, &start);
+	mem_arena_init(&arena, 0);
+	block_array = fill_block_array(stripe_params, &start, &arena);
 
 	background_rect.rx = 50;
 	background_rect.x = min_f(start.bottom.x, start.top.x) - background_rect.rx;
@@ -520,28 +628,44 @@ static void write_svg(FILE* out_stream,
 
 	debug("background w,h = (%f,%f)\n", background_rect.width, background_rect.height);
 
-	svg_open_svg(out_stream, &background_rect);
+	svg_scene_init(&scene);
 
 	if (0 && background) {
-		svg_write_background(out_stream,
+		svg_scene_add_background(&scene,
 			&svg_style_light_gray_no_stroke, NULL,
 			&background_rect);
 	}
 
-	svg_open_group(out_stream, NULL, NULL, "hannah_stripes");
+	svg_scene_open_group(&scene, NULL, NULL, "hannah_stripes");
 
 	edges = get_edges(stripe_params, block_array);
 
-	write_block(out_stream, &edges.first);
+	if (clip) {
+		block_clip.rect = &background_rect;
+	}
+
+	write_block(&scene, &edges.first, &block_clip);
 
 	for (i = 1; i < stripe_params->block_count + 1; i++) {
-		write_block(out_stream, &block_array[i]);
+		write_block(&scene, &block_array[i], &block_clip);
 	}
 
-	mem_free(block_array);
+	clip_buffer_clean(&block_clip.cb);
 
-	svg_close_group(out_stream);
-	svg_close_svg(out_stream);
+	if (clip) {
+		fprintf(stderr,
+			"%s: Clipped %u blocks, dropped %u outside the view.\n",
+			program_name, block_clip.clipped, block_clip.dropped);
+	}
+
+	svg_scene_close_group(&scene);
+
+	svg_open_svg(writer, &background_rect);
+	svg_scene_write(writer, &scene);
+	svg_close_svg(writer);
+
+	svg_scene_clean(&scene);
+	mem_arena_clean(&arena);
 }
 
 struct config_cb_data {
@@ -621,6 +745,7 @@ int main(int argc, char *argv[])
 {
 	struct opts opts;
 	FILE *out_stream;
+	struct svg_writer writer;
 
 	log_set_exit_on_error(true);
 
@@ -675,14 +800,35 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
+	if (opts.mem_stats == opt_yes) {
+		mem_census_start();
+	}
+
 	if (opts.config_file){
 		mem_free(opts.config_file);
 		opts.config_file = NULL;
 	}
 
-	srand((unsigned int)time(NULL));
+	if (opts.seed_set != opt_yes) {
+		opts.seed = (unsigned int)time(NULL);
+	}
+	log("seed = %u\n", opts.seed);
+	random_seed(opts.seed);
+
+	svg_writer_init(&writer, out_stream, 0);
+	svg_writer_set_precision(&writer, opts.precision);
+	svg_writer_set_minify(&writer, opts.minify == opt_yes);
 
-	write_svg(out_stream, &opts.stripe_params, opts.background);
+	if (opts.compress == svg_writer_compress_off &&
+		svg_writer_is_svgz(opts.output_file)) {
+		opts.compress = svg_writer_compress_default;
+	}
+	if (opts.compress != svg_writer_compress_off) {
+		svg_writer_compress(&writer, opts.compress);
+	}
+	write_svg(&writer, &opts.stripe_params, opts.background,
+		opts.clip == opt_yes);
+	svg_writer_clean(&writer);
 
 	return EXIT_SUCCESS;
 }